@@ -0,0 +1,53 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+#include <fost/insert>
+
+#include <chrono>
+
+
+namespace bench {
+
+
+    /// Run the function `count` times and return the number of runs per
+    /// second
+    template<typename F>
+    double rate(std::size_t count, F f) {
+        const auto started = std::chrono::steady_clock::now();
+        for (std::size_t run{}; run != count; ++run) { f(); }
+        const std::chrono::duration<double> taken =
+                std::chrono::steady_clock::now() - started;
+        return taken.count() > 0 ? count / taken.count() : 0.0;
+    }
+    /// The rate together with the mean time each run takes
+    template<typename F>
+    fostlib::json timed(std::size_t count, F f) {
+        const double per_second = rate(count, f);
+        fostlib::json result;
+        fostlib::insert(result, "per second", per_second);
+        fostlib::insert(
+                result, "mean ms", per_second > 0 ? 1e3 / per_second : 0.0);
+        return result;
+    }
+
+
+    /// Field decoding throughput, without needing a database
+    fostlib::json decode(std::size_t rows);
+
+    /// Connection, statement and fetch throughput against the database
+    fostlib::json database(
+            const fostlib::json &config,
+            std::size_t statements,
+            std::size_t rows);
+
+
+}
@@ -0,0 +1,90 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "bench.hpp"
+#include <fost/postgres>
+
+
+namespace {
+    /// Queries returning a single column of each type for the fetch
+    /// benchmarks
+    const std::vector<std::pair<const char *, const char *>> c_types = {
+            {"int", "n"},
+            {"float", "n::float8 / 3"},
+            {"text", "md5(n::text)"},
+            {"json", "json_build_object('id', n, 'tags', json_build_array(n))"},
+            {"timestamp", "now() + n * interval '1 second'"}};
+}
+
+
+fostlib::json bench::database(
+        const fostlib::json &config, std::size_t statements, std::size_t rows) {
+    fostlib::json results;
+    /// Counts the fields read so that the work can't be optimised away
+    std::size_t seen{};
+
+    const auto connects = std::max<std::size_t>(statements / 100, 1u);
+    insert(results, "connect", timed(connects, [&]() {
+        fostlib::pg::connection cnx(config);
+    }));
+
+    fostlib::pg::connection cnx(config);
+    insert(results, "SELECT 1", timed(statements, [&]() {
+        for (const auto &row : cnx.exec("SELECT 1")) {
+            seen += not row[0].isnull();
+        }
+    }));
+
+    cnx.exec(
+            "CREATE TEMPORARY TABLE fost_pg_bench "
+            "(id int PRIMARY KEY, name text, value float8)");
+    int64_t id{};
+    insert(results, "insert", timed(statements, [&]() {
+        fostlib::json row;
+        insert(row, "id", ++id);
+        insert(row, "name", "inserted");
+        insert(row, "value", id / 3.0);
+        cnx.insert("fost_pg_bench", row);
+    }));
+    id = 0;
+    insert(results, "upsert", timed(statements, [&]() {
+        fostlib::json key, value;
+        insert(key, "id", ++id);
+        insert(value, "name", "upserted");
+        cnx.upsert("fost_pg_bench", key, value);
+    }));
+    id = 0;
+    insert(results, "select", timed(statements, [&]() {
+        fostlib::json key;
+        insert(key, "id", ++id);
+        for (const auto &row : cnx.select("fost_pg_bench", key)) {
+            seen += not row[1].isnull();
+        }
+    }));
+    auto procedure = cnx.procedure("SELECT $1::int + 1");
+    insert(results, "procedure", timed(statements, [&]() {
+        const std::vector<fostlib::json> args{fostlib::json(++id)};
+        for (const auto &row : procedure.exec(args)) {
+            seen += not row[0].isnull();
+        }
+    }));
+    cnx.rollback();
+
+    /// Decoding every field of a fetched column, in rows per second
+    for (const auto &[name, expression] : c_types) {
+        auto records = cnx.exec(
+                std::string("SELECT ") + expression
+                + " FROM generate_series(1, " + std::to_string(rows) + ") n");
+        const double decoded = rate(1, [&]() {
+            for (const auto &row : records) { seen += not row[0].isnull(); }
+        });
+        insert(results, "decode", name, decoded * rows);
+    }
+    insert(results, "fields", int64_t(seen));
+    return results;
+}
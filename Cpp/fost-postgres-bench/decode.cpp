@@ -0,0 +1,140 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "bench.hpp"
+#include <fost/exception/parse_error.hpp>
+#include <fost/insert>
+#include <fost/parse/parse.hpp>
+#include <fost/pg/decoder.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+    struct column {
+        const char *name;
+        unsigned int oid;
+        std::string_view text;
+    };
+    const std::vector<column> c_row = {
+            {"int", 20, "1234567890"},
+            {"float", 701, "3.14159265358979"},
+            {"bool", 16, "t"},
+            {"text", 25, "The quick brown fox jumps over the lazy dog"},
+            {"timestamp", 1184, "2020-05-21 10:15:30.25+07"},
+            {"json", 3802, "{\"id\": 1234, \"tags\": [\"a\", \"b\"]}"}};
+
+
+    /**
+        The field decoding that recordsets used before the decoders, kept
+        here as the baseline for the figures
+    */
+    int64_t int_parser(const std::string &value) {
+        int64_t ret{0};
+        auto pos = value.begin();
+        if (not boost::spirit::qi::parse(
+                    pos, value.end(), boost::spirit::qi::int_parser<int64_t>(),
+                    ret)
+            && pos == value.end()) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing an int", value);
+        } else {
+            return ret;
+        }
+    }
+    double float_parser(const std::string &value) {
+        double ret{0};
+        auto pos = value.begin();
+        if (not boost::spirit::qi::parse(
+                    pos, value.end(), boost::spirit::qi::double_, ret)
+            && pos == value.end()) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing a double", value);
+        } else {
+            return ret;
+        }
+    }
+    fostlib::json fillin(unsigned int oid, const char *value) {
+        switch (oid) {
+        case 16: // bool
+            return fostlib::json(value[0] == 't' ? true : false);
+        case 21: // int2
+        case 23: // int4
+        case 20: // int8
+        case 26: // oid
+            return fostlib::json(int_parser(value));
+        case 700: // float4
+        case 701: // float8
+            return fostlib::json(float_parser(value));
+        case 114: // json
+        case 3802: // jsonb
+            return fostlib::json::parse(value);
+        default: return fostlib::coerce<fostlib::json>(value);
+        }
+    }
+}
+
+
+fostlib::json bench::decode(std::size_t rows) {
+    using decoder = fostlib::pg::decoder<fostlib::json>;
+    fostlib::json results;
+    std::size_t decoded{};
+
+    /// The old switch on the type with the Spirit parsers, which takes the
+    /// NUL terminated text that libpqxx gives us
+    std::vector<std::string> texts;
+    for (const auto &c : c_row) { texts.emplace_back(c.text); }
+    const double baseline = rate(rows, [&]() {
+        for (std::size_t index{}; index != c_row.size(); ++index) {
+            decoded += not fillin(c_row[index].oid, texts[index].c_str())
+                                   .isnull();
+        }
+    });
+    insert(results, "rows", "baseline", baseline);
+
+    /// Resolving the decoder from the type for every field
+    const double per_field = rate(rows, [&]() {
+        for (const auto &c : c_row) {
+            decoded += not decoder::decode(c.oid, c.text).isnull();
+        }
+    });
+    insert(results, "rows", "per field", per_field);
+
+    /// Resolving the decoders once and then dispatching for each field,
+    /// which is what a recordset does
+    std::vector<decoder::function> plan;
+    for (const auto &c : c_row) { plan.push_back(decoder::plan(c.oid)); }
+    const double planned = rate(rows, [&]() {
+        for (std::size_t index{}; index != c_row.size(); ++index) {
+            const auto &c = c_row[index];
+            decoded += not plan[index](c.oid, c.text).isnull();
+        }
+    });
+    insert(results, "rows", "planned", planned);
+
+    for (const auto &c : c_row) {
+        const auto f = decoder::plan(c.oid);
+        const double fields = rate(rows, [&]() {
+            decoded += not f(c.oid, c.text).isnull();
+        });
+        insert(results, "fields", c.name, fields);
+    }
+    /// The general purpose JSON parser, which was used before for `json`
+    /// and `jsonb` fields
+    const std::string document{c_row.back().text};
+    const double parsed = rate(rows, [&]() {
+        decoded += not fostlib::json::parse(fostlib::string(document)).isnull();
+    });
+    insert(results, "fields", "json (general parser)", parsed);
+
+    /// Reported so the decoding can't be optimised away
+    insert(results, "decoded", int64_t(decoded));
+    return results;
+}
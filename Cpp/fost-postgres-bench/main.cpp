@@ -0,0 +1,51 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "bench.hpp"
+#include <fost/insert>
+#include <fost/main>
+
+
+namespace {
+    const fostlib::setting<int64_t> c_rows(
+            __FILE__, "fost-postgres-bench", "Rows", 200000, true);
+    const fostlib::setting<int64_t> c_statements(
+            __FILE__, "fost-postgres-bench", "Statements", 2000, true);
+    const fostlib::setting<fostlib::string> c_host(
+            __FILE__, "fost-postgres-bench", "Host", "", true);
+    const fostlib::setting<fostlib::string> c_database(
+            __FILE__, "fost-postgres-bench", "Database", "", true);
+}
+
+
+FSL_MAIN("fost-postgres-bench", "Benchmarks for fost-postgres")
+(fostlib::ostream &out, fostlib::arguments &args) {
+    args.commandSwitch("rows", c_rows);
+    args.commandSwitch("statements", c_statements);
+    args.commandSwitch("h", c_host);
+    args.commandSwitch("d", c_database);
+    const std::size_t rows = c_rows.value();
+
+    fostlib::json results;
+    insert(results, "decode", bench::decode(rows));
+
+    fostlib::json config = fostlib::json::object_t();
+    if (not c_host.value().empty()) { insert(config, "host", c_host.value()); }
+    if (not c_database.value().empty()) {
+        insert(config, "dbname", c_database.value());
+    }
+    try {
+        insert(results, "database",
+               bench::database(config, c_statements.value(), rows));
+    } catch (std::exception &e) {
+        /// The decode results are still useful without a database
+        insert(results, "database", "error", e.what());
+    }
+    out << fostlib::json::unparse(results, true) << std::endl;
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/postgres>
+#include <fost/test>
+
+
+FSL_TEST_SUITE(cache);
+
+
+namespace {
+    fostlib::json name_of(fostlib::pg::connection &cnx, int id) {
+        fostlib::json keys;
+        fostlib::insert(keys, "id", id);
+        return (*cnx.select("cached_rows", keys).begin())["name"];
+    }
+    fostlib::json cache_figure(fostlib::pg::connection &cnx, const char *name) {
+        return cnx.statistics()["cache"][name];
+    }
+}
+
+
+FSL_TEST_FUNCTION(select_results_are_cached) {
+    fostlib::json config;
+    fostlib::insert(config, "cache", "ttl", 300);
+    fostlib::pg::connection cnx(config);
+    cnx.exec(
+            "CREATE TEMPORARY TABLE cached_rows "
+            "(id int PRIMARY KEY, name text)");
+    fostlib::json row;
+    fostlib::insert(row, "id", 1);
+    fostlib::insert(row, "name", "first");
+    cnx.insert("cached_rows", row);
+
+    /// Uncommitted writes mustn't be seen through the cache
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("first"));
+    FSL_CHECK_EQ(cache_figure(cnx, "stored"), fostlib::json(0));
+    cnx.commit();
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("first"));
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("first"));
+    FSL_CHECK_EQ(cache_figure(cnx, "stored"), fostlib::json(1));
+    FSL_CHECK_EQ(cache_figure(cnx, "hits"), fostlib::json(1));
+
+    /// Writes made with `exec` aren't seen until invalidated
+    cnx.exec("UPDATE cached_rows SET name='second'");
+    cnx.commit();
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("first"));
+    cnx.invalidate("cached_rows");
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("second"));
+
+    fostlib::json keys, values;
+    fostlib::insert(keys, "id", 1);
+    fostlib::insert(values, "name", "third");
+    cnx.update("cached_rows", keys, values);
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("third"));
+    cnx.commit();
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("third"));
+
+    auto procedure = cnx.procedure("SELECT name FROM cached_rows WHERE id=$1");
+    const auto hits = fostlib::coerce<int64_t>(cache_figure(cnx, "hits"));
+    FSL_CHECK_EQ(
+            (*procedure.cached({fostlib::json(1)}).begin())[0],
+            fostlib::json("third"));
+    FSL_CHECK_EQ(
+            (*procedure.cached({fostlib::json(1)}).begin())[0],
+            fostlib::json("third"));
+    FSL_CHECK_EQ(cache_figure(cnx, "hits"), fostlib::json(hits + 1));
+
+    /// An invalidation after the transaction started may be for a write
+    /// its snapshot doesn't include, so its results aren't stored
+    fostlib::pg::connection other(config);
+    cnx.commit();
+    other.invalidate("cached_rows");
+    const auto stored = fostlib::coerce<int64_t>(cache_figure(cnx, "stored"));
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("third"));
+    FSL_CHECK_EQ(cache_figure(cnx, "stored"), fostlib::json(stored));
+    cnx.commit();
+    FSL_CHECK_EQ(name_of(cnx, 1), fostlib::json("third"));
+    FSL_CHECK_EQ(cache_figure(cnx, "stored"), fostlib::json(stored + 1));
+
+    /// Nor are procedure results read after a write in the transaction
+    fostlib::json fourth;
+    fostlib::insert(fourth, "id", 2);
+    fostlib::insert(fourth, "name", "fourth");
+    cnx.insert("cached_rows", fourth);
+    FSL_CHECK_EQ(
+            (*procedure.cached({fostlib::json(2)}).begin())[0],
+            fostlib::json("fourth"));
+    FSL_CHECK_EQ(cache_figure(cnx, "stored"), fostlib::json(stored + 1));
+    cnx.rollback();
+}
+
+
+FSL_TEST_FUNCTION(own_writes_skip_the_cache) {
+    fostlib::pg::connection setup;
+    setup.exec("DROP TABLE IF EXISTS fost_pg_cache_shared");
+    setup.exec(
+            "CREATE TABLE fost_pg_cache_shared "
+            "(id int PRIMARY KEY, name text)");
+    setup.exec("INSERT INTO fost_pg_cache_shared VALUES (1, 'before')");
+    setup.commit();
+
+    fostlib::json config, keys, values;
+    fostlib::insert(config, "cache", "ttl", 300);
+    fostlib::insert(keys, "id", 1);
+    fostlib::insert(values, "name", "after");
+    const auto name = [&keys](fostlib::pg::connection &cnx) {
+        return (*cnx.select("fost_pg_cache_shared", keys).begin())["name"];
+    };
+
+    /// Another connection sharing the cache stores what it reads
+    fostlib::pg::connection reader(config);
+    auto read = reader.procedure(
+            "SELECT name FROM fost_pg_cache_shared WHERE id=$1");
+    FSL_CHECK_EQ(name(reader), fostlib::json("before"));
+    FSL_CHECK_EQ(
+            (*read.cached({fostlib::json(1)}).begin())[0],
+            fostlib::json("before"));
+    reader.commit();
+
+    /// The writer must see its own uncommitted write rather than those
+    /// results
+    fostlib::pg::connection writer(config);
+    auto write = writer.procedure(
+            "SELECT name FROM fost_pg_cache_shared WHERE id=$1");
+    writer.update("fost_pg_cache_shared", keys, values);
+    FSL_CHECK_EQ(name(writer), fostlib::json("after"));
+    FSL_CHECK_EQ(
+            (*write.cached({fostlib::json(1)}).begin())[0],
+            fostlib::json("after"));
+    writer.rollback();
+
+    setup.exec("DROP TABLE fost_pg_cache_shared");
+    setup.commit();
+}
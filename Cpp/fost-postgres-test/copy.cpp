@@ -0,0 +1,106 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/exception/out_of_range.hpp>
+#include <fost/postgres>
+#include <fost/test>
+
+#include <optional>
+#include <sstream>
+
+
+FSL_TEST_SUITE(copy);
+
+
+FSL_TEST_FUNCTION(copy_in_rows) {
+    fostlib::pg::connection cnx;
+    cnx.exec(
+            "CREATE TEMPORARY TABLE copy_in_rows "
+            "(id int, name text, doc jsonb)");
+    auto writer = cnx.copy_in("copy_in_rows", {"id", "name", "doc"}, 16);
+    fostlib::json arr, obj, doc;
+    fostlib::jcursor().push_back(arr, fostlib::json(1));
+    fostlib::jcursor().push_back(arr, fostlib::json("tab\there\\"));
+    fostlib::insert(doc, "key", "line\nbreak");
+    fostlib::jcursor().push_back(arr, fostlib::json(doc));
+    writer.row(arr);
+    fostlib::insert(obj, "id", 2);
+    writer.row(obj);
+    writer.row(std::make_tuple(3, "three", std::optional<std::string>{}));
+    /// A short row is rejected without leaving anything behind
+    FSL_CHECK_EXCEPTION(
+            writer.row(std::make_tuple(4, "four")),
+            fostlib::exceptions::out_of_range<std::size_t> &);
+    FSL_CHECK_EQ(writer.complete(), 3u);
+
+    auto records = cnx.exec("SELECT * FROM copy_in_rows ORDER BY id");
+    auto row = records.begin();
+    FSL_CHECK_EQ((*row)[1], fostlib::json("tab\there\\"));
+    FSL_CHECK_EQ((*row)[2], doc);
+    ++row;
+    FSL_CHECK_EQ((*row)[0], fostlib::json(2));
+    FSL_CHECK_EQ((*row)[1], fostlib::json());
+    ++row;
+    FSL_CHECK_EQ((*row)[1], fostlib::json("three"));
+    FSL_CHECK_EQ((*row)[2], fostlib::json());
+}
+
+
+FSL_TEST_FUNCTION(copy_in_abandoned) {
+    /// Without a transaction the rows would be visible straight away if
+    /// the COPY were completed
+    fostlib::json none;
+    fostlib::insert(none, "transaction", "isolation", "none");
+    fostlib::pg::connection cnx(none);
+    cnx.exec("CREATE TEMPORARY TABLE copy_abandoned (id int)");
+    try {
+        auto writer = cnx.copy_in("copy_abandoned", {"id"});
+        writer.row(std::make_tuple(1));
+        writer.flush();
+        throw std::runtime_error("Abandon the COPY");
+    } catch (std::runtime_error &) {}
+    FSL_CHECK_EQ(
+            (*cnx.exec("SELECT count(*) FROM copy_abandoned").begin())[0],
+            fostlib::json(0));
+
+    std::optional<fostlib::pg::copy_writer> orphan;
+    {
+        fostlib::pg::connection gone;
+        gone.exec("CREATE TEMPORARY TABLE copy_orphan (id int)");
+        orphan.emplace(gone.copy_in("copy_orphan", {"id"}));
+    }
+    orphan->row(std::make_tuple(1));
+    FSL_CHECK_EXCEPTION(orphan->flush(), fostlib::exceptions::null &);
+}
+
+
+FSL_TEST_FUNCTION(copy_out_rows) {
+    fostlib::pg::connection cnx;
+    const char *sql =
+            "SELECT * FROM (VALUES (1, 'plain'), (2, 'tab\there, \"quoted\"'), "
+            "(3, ''), (4, NULL)) AS v(id, name)";
+    std::string text;
+    FSL_CHECK_EQ(
+            cnx.copy_out(
+                    sql, [&text](std::string_view chunk) { text += chunk; },
+                    fostlib::pg::copy_format::text, 1),
+            4u);
+    FSL_CHECK_EQ(
+            text,
+            std::string(
+                    "1\tplain\n2\ttab\\there, \"quoted\"\n3\t\n4\t\\N\n"));
+
+    std::stringstream csv;
+    FSL_CHECK_EQ(
+            cnx.copy_out(sql, csv, fostlib::pg::copy_format::csv), 4u);
+    FSL_CHECK_EQ(
+            csv.str(),
+            std::string("1,plain\n2,\"tab\there, \"\"quoted\"\"\"\n3,\"\"\n"
+                        "4,\n"));
+}
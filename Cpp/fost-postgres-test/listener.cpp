@@ -0,0 +1,81 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/postgres>
+#include <fost/test>
+
+
+FSL_TEST_SUITE(listener);
+
+
+FSL_TEST_FUNCTION(notifications_are_dispatched) {
+    fostlib::pg::listener listener;
+    std::vector<fostlib::string> heard;
+    listener.listen("fost_test", [&](const auto &n) {
+        FSL_CHECK_EQ(n.channel, fostlib::string("fost_test"));
+        heard.push_back(n.payload);
+    });
+    FSL_CHECK_EQ(listener.wait(std::chrono::milliseconds{10}), 0u);
+
+    fostlib::pg::connection cnx;
+    cnx.exec("NOTIFY fost_test, 'first'");
+    cnx.exec("NOTIFY fost_other, 'ignored'");
+    cnx.exec("SELECT pg_notify('fost_test', 'second')");
+    /// Nothing is delivered until the transaction commits
+    FSL_CHECK_EQ(listener.wait(std::chrono::milliseconds{10}), 0u);
+    cnx.commit();
+
+    std::size_t received{};
+    while (received < 2) {
+        const auto n = listener.wait(std::chrono::seconds{5});
+        FSL_CHECK(n > 0u);
+        received += n;
+    }
+    FSL_CHECK_EQ(heard.size(), 2u);
+    FSL_CHECK_EQ(heard[0], fostlib::string("first"));
+    FSL_CHECK_EQ(heard[1], fostlib::string("second"));
+
+    listener.unlisten("fost_test");
+    cnx.exec("NOTIFY fost_test, 'third'");
+    cnx.commit();
+    FSL_CHECK_EQ(listener.wait(std::chrono::milliseconds{100}), 0u);
+    FSL_CHECK_EQ(heard.size(), 2u);
+}
+
+
+FSL_TEST_FUNCTION(callbacks_can_change_listening) {
+    fostlib::pg::listener listener;
+    std::vector<fostlib::string> heard;
+    listener.listen("fost_once", [&](const auto &n) {
+        heard.push_back(n.payload);
+        listener.unlisten("fost_once");
+        listener.listen("fost_later", [&](const auto &later) {
+            heard.push_back(later.payload);
+        });
+    });
+    listener.listen("fost_once", [&](const auto &) {
+        heard.push_back(fostlib::string("unlistened"));
+    });
+
+    fostlib::pg::connection cnx;
+    cnx.exec("NOTIFY fost_once, 'first'");
+    cnx.exec("NOTIFY fost_once, 'second'");
+    cnx.exec("NOTIFY fost_later, 'third'");
+    cnx.commit();
+
+    std::size_t received{};
+    while (received < 3) {
+        const auto n = listener.wait(std::chrono::seconds{5});
+        FSL_CHECK(n > 0u);
+        received += n;
+    }
+    FSL_CHECK_EQ(heard.size(), 2u);
+    FSL_CHECK_EQ(heard[0], fostlib::string("first"));
+    FSL_CHECK_EQ(heard[1], fostlib::string("third"));
+}
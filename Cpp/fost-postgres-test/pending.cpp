@@ -0,0 +1,59 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/postgres>
+#include <fost/test>
+
+#include <chrono>
+#include <stdexcept>
+#include <poll.h>
+
+
+FSL_TEST_SUITE(pending);
+
+
+FSL_TEST_FUNCTION(exec_async) {
+    fostlib::pg::connection cnx;
+    auto procedure = cnx.procedure("SELECT $1::int * 2");
+    auto slow = cnx.exec_async("SELECT pg_sleep(0.1), 1");
+    auto quick = procedure.exec_async({fostlib::json(21)});
+
+    /// Drive the commands from the socket as an event loop would
+    const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    pollfd fd{cnx.socket(), POLLIN, 0};
+    while (not quick.ready()) {
+        FSL_CHECK(std::chrono::steady_clock::now() < deadline);
+        FSL_CHECK(::poll(&fd, 1, 100) >= 0);
+    }
+    /// Commands finish in the order they were sent
+    FSL_CHECK(slow.ready());
+    FSL_CHECK_EQ((*quick.get().begin())[0], fostlib::json(42));
+    FSL_CHECK_EQ((*slow.get().begin())[1], fostlib::json(1));
+    FSL_CHECK_EXCEPTION(slow.get(), fostlib::exceptions::not_implemented &);
+
+    /// Once everything has been read the connection can be used normally
+    FSL_CHECK_EQ((*cnx.exec("SELECT 3").begin())[0], fostlib::json(3));
+}
+
+
+FSL_TEST_FUNCTION(ending_the_transaction) {
+    fostlib::pg::connection cnx;
+    auto unread = cnx.exec_async("SELECT 1");
+    FSL_CHECK_EXCEPTION(cnx.commit(), std::logic_error &);
+    FSL_CHECK_EQ((*unread.get().begin())[0], fostlib::json(1));
+    cnx.commit();
+
+    auto abandoned = cnx.exec_async("SELECT 2");
+    cnx.rollback();
+    FSL_CHECK(abandoned.ready());
+    FSL_CHECK_EXCEPTION(
+            abandoned.get(), fostlib::exceptions::not_implemented &);
+    FSL_CHECK_EQ((*cnx.exec("SELECT 3").begin())[0], fostlib::json(3));
+}
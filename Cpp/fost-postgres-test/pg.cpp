@@ -7,10 +7,15 @@
 
 
 #include "fost-postgres-test.hpp"
+#include <fost/exception/out_of_range.hpp>
+#include <fost/exception/parse_error.hpp>
 #include <fost/postgres>
 #include <fost/test>
 
+#include <clocale>
 #include <cstdlib>
+#include <optional>
+#include <set>
 
 
 using namespace fostlib;
@@ -130,4 +135,549 @@ FSL_TEST_FUNCTION(transform_null_to_string_type) {
     auto n = fostlib::json();
     FSL_CHECK(n.isnull());
     use_value_in_where_clause(n);
-}
\ No newline at end of file
+}
+
+FSL_TEST_FUNCTION(select_statement_is_cached) {
+    fostlib::json first, second;
+    fostlib::insert(first, "table_name", "pg_class");
+    fostlib::insert(second, "table_name", "pg_type");
+    fostlib::pg::connection cnx;
+    cnx.select("information_schema.tables", first);
+    FSL_CHECK_EQ(
+            cnx.statistics()["statements"]["misses"], fostlib::json(1));
+    cnx.select("information_schema.tables", second);
+    FSL_CHECK_EQ(cnx.statistics()["statements"]["hits"], fostlib::json(1));
+    FSL_CHECK_EQ(cnx.statistics()["statements"]["cached"], fostlib::json(1));
+}
+
+FSL_TEST_FUNCTION(select_without_statement_cache) {
+    const fostlib::setting<int64_t> no_cache(
+            "fost-postgres-test/pg.cpp", "Postgres",
+            "Prepared statement cache size", 0);
+    fostlib::json lookup;
+    fostlib::insert(lookup, "table_name", "pg_class");
+    fostlib::pg::connection cnx;
+    auto records = cnx.select("information_schema.tables", lookup);
+    FSL_CHECK(records.begin() != records.end());
+    FSL_CHECK_EQ(cnx.statistics()["statements"]["cached"], fostlib::json(0));
+}
+
+
+FSL_TEST_FUNCTION(query_metrics) {
+    fostlib::pg::connection off;
+    off.exec("SELECT 1");
+    FSL_CHECK(not off.statistics().has_key("queries"));
+
+    const fostlib::setting<bool> metrics(
+            "fost-postgres-test/pg.cpp", "Postgres", "Query metrics", true);
+    fostlib::pg::connection cnx;
+    const std::string sql = "SELECT * FROM generate_series(1, 10)";
+    cnx.exec(sql);
+    cnx.exec(sql);
+    const auto queries = cnx.statistics()["queries"];
+    FSL_CHECK_EQ(queries["total"]["count"], fostlib::json(2));
+    const auto statement = queries["statements"][fostlib::string(sql)];
+    FSL_CHECK_EQ(statement["rows"], fostlib::json(20));
+    FSL_CHECK_EQ(statement["bytes"], fostlib::json(22));
+    int64_t bucketed{};
+    for (const auto &n : statement["histogram"]) {
+        bucketed += fostlib::coerce<int64_t>(n);
+    }
+    FSL_CHECK_EQ(bucketed, 2);
+
+    fostlib::json lookup;
+    fostlib::insert(lookup, "table_name", "pg_class");
+    cnx.select("information_schema.tables", lookup);
+    FSL_CHECK_EQ(
+            cnx.statistics()["queries"]["prepared"]["count"],
+            fostlib::json(1));
+    const auto process = fostlib::pg::connection::process_statistics();
+    FSL_CHECK(fostlib::coerce<int64_t>(process["total"]["count"]) >= 3);
+}
+
+
+FSL_TEST_FUNCTION(batch_insert_and_upsert) {
+    fostlib::pg::connection cnx;
+    cnx.exec(
+            "CREATE TEMPORARY TABLE batch_rows "
+            "(id int PRIMARY KEY, name text)");
+    std::vector<fostlib::json> rows;
+    for (int id{}; id != 5; ++id) {
+        fostlib::json row;
+        fostlib::insert(row, "id", id);
+        if (id % 2) { fostlib::insert(row, "name", "odd"); }
+        rows.push_back(row);
+    }
+    auto inserted = cnx.insert("batch_rows", rows, {"id"});
+    int count{};
+    for (const auto &row : inserted) {
+        FSL_CHECK_EQ(row[0], fostlib::json(count++));
+    }
+    FSL_CHECK_EQ(count, 5);
+
+    std::vector<fostlib::json> named;
+    for (int id{}; id != 5; ++id) {
+        fostlib::json row;
+        fostlib::insert(row, "id", id);
+        fostlib::insert(row, "name", "updated");
+        named.push_back(row);
+    }
+    auto upserted = cnx.upsert("batch_rows", {"id"}, named, {"name"});
+    for (const auto &row : upserted) {
+        FSL_CHECK_EQ(row[0], fostlib::json("updated"));
+    }
+    FSL_CHECK_EQ(std::distance(upserted.begin(), upserted.end()), 5);
+}
+
+
+FSL_TEST_FUNCTION(stream_rows) {
+    fostlib::pg::connection cnx;
+    auto records = cnx.stream("SELECT * FROM generate_series(1, 25)", 10);
+    int64_t expected{};
+    for (const auto &row : records) {
+        FSL_CHECK_EQ(row[0], fostlib::json(++expected));
+    }
+    FSL_CHECK_EQ(expected, 25);
+    auto empty = cnx.stream("SELECT 1 WHERE false", 10);
+    FSL_CHECK(empty.begin() == empty.end());
+    FSL_CHECK_EXCEPTION(
+            records.begin(), fostlib::exceptions::not_implemented &);
+
+    std::optional<fostlib::pg::recordset> orphan;
+    {
+        fostlib::pg::connection gone;
+        orphan.emplace(
+                gone.stream("SELECT * FROM generate_series(1, 25)", 10));
+    }
+    FSL_CHECK_EXCEPTION(
+            std::distance(orphan->begin(), orphan->end()),
+            fostlib::exceptions::null &);
+}
+
+
+FSL_TEST_FUNCTION(keyset_scan) {
+    fostlib::pg::connection cnx;
+    cnx.exec(
+            "CREATE TEMPORARY TABLE scanned AS SELECT n / 10 AS a, n % 10 AS "
+            "b, n % 2 AS odd, n FROM generate_series(0, 99) n");
+    fostlib::json odd;
+    fostlib::insert(odd, "odd", 1);
+    auto records = cnx.scan("scanned", odd, {"a", "b"}, 7, {"n"});
+    int64_t expected{-1};
+    for (const auto &row : records) {
+        FSL_CHECK_EQ(row.size(), 3u);
+        FSL_CHECK_EQ(row[0], fostlib::json(expected += 2));
+    }
+    FSL_CHECK_EQ(expected, 99);
+
+    /// Whole pages are followed by an empty one
+    std::size_t rows{};
+    const fostlib::json all = fostlib::json::object_t();
+    for (const auto &row : cnx.scan("scanned", all, {"n"}, 10)) {
+        FSL_CHECK_EQ(row["n"], fostlib::json(int64_t(rows++)));
+    }
+    FSL_CHECK_EQ(rows, 100u);
+    FSL_CHECK_EXCEPTION(
+            cnx.scan("scanned", all, {}),
+            fostlib::exceptions::not_implemented &);
+}
+
+
+FSL_TEST_FUNCTION(select_many_keys) {
+    fostlib::pg::connection cnx;
+    cnx.exec(
+            "CREATE TEMPORARY TABLE many AS SELECT n / 10 AS a, n % 10 AS b, "
+            "n FROM generate_series(0, 99) n");
+    /// Duplicate and null keys are skipped
+    auto single = cnx.select_many(
+            "many", {"n"},
+            {fostlib::json(3), fostlib::json(5), fostlib::json(5),
+             fostlib::json(), fostlib::json(500)});
+    std::set<int64_t> found;
+    for (const auto &row : single) {
+        found.insert(fostlib::coerce<int64_t>(row["n"]));
+    }
+    FSL_CHECK_EQ(found.size(), 2u);
+    FSL_CHECK(found.count(3) && found.count(5));
+
+    std::vector<fostlib::json> keys;
+    for (const int n : {12, 99, 420}) {
+        fostlib::json key;
+        fostlib::insert(key, "a", n / 10);
+        fostlib::insert(key, "b", n % 10);
+        keys.push_back(key);
+    }
+    found.clear();
+    for (const auto &row : cnx.select_many("many", {"a", "b"}, keys, {"n"})) {
+        FSL_CHECK_EQ(row.size(), 3u);
+        FSL_CHECK_EQ(
+                fostlib::coerce<int64_t>(row[0]),
+                fostlib::coerce<int64_t>(row["a"]) * 10
+                        + fostlib::coerce<int64_t>(row["b"]));
+        found.insert(fostlib::coerce<int64_t>(row[0]));
+    }
+    FSL_CHECK_EQ(found.size(), 2u);
+    FSL_CHECK(found.count(12) && found.count(99));
+}
+
+
+FSL_TEST_FUNCTION(fields_decode_on_access) {
+    fostlib::pg::connection cnx;
+    auto records = cnx.exec(
+            "SELECT n, n::text, '{}'::jsonb FROM generate_series(1, 2) n");
+    auto row = records.begin();
+    auto first = *row;
+    FSL_CHECK_EQ((*row)[1], fostlib::json("1"));
+    ++row;
+    FSL_CHECK_EQ(first[0], fostlib::json(1));
+    FSL_CHECK_EQ((*row)[0], fostlib::json(2));
+    std::size_t fields{};
+    for (const auto &field : *row) {
+        FSL_CHECK(not field.isnull());
+        ++fields;
+    }
+    FSL_CHECK_EQ(fields, 3u);
+}
+
+
+FSL_TEST_FUNCTION(typed_rows) {
+    fostlib::pg::connection cnx;
+    auto records = cnx.exec(
+            "SELECT n, n::text, NULL::int4, "
+            "'2020-05-21 10:15:30.25+07'::timestamptz "
+            "FROM generate_series(1, 3) n");
+    int64_t expected{};
+    for (auto [id, name, missing, when] :
+         records.as<int64_t, std::string_view, std::optional<int32_t>,
+                    std::chrono::system_clock::time_point>()) {
+        FSL_CHECK_EQ(id, ++expected);
+        FSL_CHECK_EQ(std::string(name), std::to_string(expected));
+        FSL_CHECK(not missing);
+        FSL_CHECK_EQ(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                        when.time_since_epoch())
+                        .count(),
+                1590030930250);
+    }
+    FSL_CHECK_EQ(expected, 3);
+
+    using time_point = std::chrono::system_clock::time_point;
+    auto infinite = cnx.exec(
+            "SELECT 'infinity'::timestamptz, '-infinity'::timestamptz");
+    for (auto [late, early] : infinite.as<time_point, time_point>()) {
+        FSL_CHECK(late == time_point::max());
+        FSL_CHECK(early == time_point::min());
+    }
+    FSL_CHECK_EXCEPTION(
+            fostlib::pg::decoder<time_point>::decode(
+                    1184, "300000-01-01 00:00:00+00"),
+            fostlib::exceptions::parse_error &);
+
+    FSL_CHECK_EXCEPTION(
+            records.as<int64_t>(), fostlib::exceptions::not_implemented &);
+    FSL_CHECK_EXCEPTION(
+            (records.as<bool, std::string, int, std::string>()),
+            fostlib::exceptions::not_implemented &);
+}
+
+
+FSL_TEST_FUNCTION(floats_ignore_the_locale) {
+    const std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+    /// A locale using a comma for the decimal point, if there is one
+    if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+        FSL_CHECK_EQ(fostlib::pg::decoder<double>::decode(701, "2.5"), 2.5);
+        FSL_CHECK_EQ(
+                fostlib::pg::decoder<fostlib::json>::decode(
+                        3802, "{\"n\": 0.125}")["n"],
+                fostlib::json(0.125));
+        std::setlocale(LC_NUMERIC, previous.c_str());
+    }
+}
+
+
+FSL_TEST_FUNCTION(columnar) {
+    fostlib::pg::connection cnx;
+    auto records = cnx.exec(
+            "SELECT n AS id, n::float8 / 2 AS half, "
+            "CASE WHEN n % 2 = 0 THEN n END AS even "
+            "FROM generate_series(1, 4) n");
+    auto ids = records.column<int64_t>("id");
+    FSL_CHECK_EQ(ids.values.size(), 4u);
+    FSL_CHECK_EQ(ids.values[3], 4);
+    auto [halves, evens] = records.columnar<double, int32_t>({1, 2});
+    FSL_CHECK_EQ(halves.values[0], 0.5);
+    FSL_CHECK(evens.nulls[0]);
+    FSL_CHECK(not evens.nulls[1]);
+    FSL_CHECK_EQ(evens.values[1], 2);
+}
+
+
+FSL_TEST_FUNCTION(binary_results) {
+    fostlib::pg::connection cnx;
+    const char *sql =
+            "SELECT n::int2 AS small, n * 100000 AS int, "
+            "n::int8 * 10000000000 AS big, n::float4 / 4 AS single, "
+            "n::float8 / 3 AS double, n % 2 = 0 AS even, "
+            "('{\"n\": ' || n || '}')::jsonb AS doc, "
+            "md5(n::text)::uuid AS id, (n * 12345.678)::numeric(12, 4) AS num, "
+            "'0.001'::numeric AS fraction, date '2020-02-29' + n AS day, "
+            "NULL::int4 AS nothing "
+            "FROM generate_series(1, 3) n";
+    auto text = cnx.exec(sql);
+    auto binary = cnx.exec(sql, fostlib::pg::result_format::binary);
+    auto t = text.begin();
+    for (const auto &row : binary) {
+        FSL_CHECK(t != text.end());
+        for (std::size_t index{}; index != row.size(); ++index) {
+            FSL_CHECK_EQ(row[index], (*t)[index]);
+        }
+        ++t;
+    }
+    FSL_CHECK(t == text.end());
+    FSL_CHECK_EXCEPTION(
+            cnx.exec(sql, fostlib::pg::result_format::binary).column<int>(0),
+            fostlib::exceptions::not_implemented &);
+
+    /// Time stamps are only read in binary when the session's time zone
+    /// is UTC. Types without a binary decoder are always read as text.
+    const char *zoned =
+            "SELECT n, timestamptz '2020-07-01 12:34:56.5Z' + n * "
+            "interval '1 hour' AS stamp FROM generate_series(1, 3) n";
+    const char *unknown = "SELECT 1 AS n, interval '1 day' AS period";
+    auto same = [&cnx](const char *sql) {
+        auto text = cnx.exec(sql);
+        auto binary = cnx.exec(sql, fostlib::pg::result_format::binary);
+        auto t = text.begin();
+        for (const auto &row : binary) {
+            FSL_CHECK_EQ(row[1], (*t)[1]);
+            ++t;
+        }
+        FSL_CHECK(t == text.end());
+    };
+    cnx.zoneinfo("UTC");
+    same(zoned);
+    FSL_CHECK_EXCEPTION(
+            cnx.exec(zoned, fostlib::pg::result_format::binary)
+                    .column<int>(0),
+            fostlib::exceptions::not_implemented &);
+    cnx.zoneinfo("Asia/Bangkok");
+    same(zoned);
+    same(unknown);
+    FSL_CHECK_EQ(
+            cnx.exec(unknown, fostlib::pg::result_format::binary)
+                    .column<int>(0)
+                    .values.size(),
+            1u);
+
+    /// Dates are only read in binary with the ISO date style
+    const char *dated = "SELECT 1 AS n, date '2020-02-29' AS day";
+    cnx.set_session("DateStyle", "SQL, DMY");
+    same(dated);
+    cnx.set_session("DateStyle", "ISO, MDY");
+
+    /// Choosing the text format doesn't run the query a second time
+    cnx.exec("CREATE TEMPORARY SEQUENCE binary_once");
+    const char *counted =
+            "SELECT nextval('binary_once') AS n, interval '1 day' AS period";
+    for (const auto &row :
+         cnx.exec(counted, fostlib::pg::result_format::binary)) {
+        FSL_CHECK_EQ(row[0], fostlib::json(1));
+    }
+    for (const auto &row :
+         cnx.stream(counted, 10, fostlib::pg::result_format::binary)) {
+        FSL_CHECK_EQ(row[0], fostlib::json(2));
+    }
+    FSL_CHECK_EQ(
+            (*cnx.exec("SELECT nextval('binary_once')").begin())[0],
+            fostlib::json(3));
+}
+
+
+FSL_TEST_FUNCTION(bytea) {
+    fostlib::pg::connection cnx;
+    const char *sql = "SELECT '\\x00ff41'::bytea, NULL::bytea";
+    const std::vector<unsigned char> expected{0x00, 0xff, 0x41};
+    const std::string_view bytes{"\0\xff\x41", 3};
+    std::vector<unsigned char> buffer;
+    for (auto format :
+         {fostlib::pg::result_format::text,
+          fostlib::pg::result_format::binary}) {
+        for (const auto &row : cnx.exec(sql, format)) {
+            FSL_CHECK_EQ(row[0], fostlib::json("\\x00ff41"));
+            FSL_CHECK(row.bytes(0, buffer) == bytes);
+            FSL_CHECK(not row.bytes(1, buffer));
+        }
+    }
+    using bytes_type = std::vector<unsigned char>;
+    auto blobs = cnx.exec(sql);
+    for (auto [b, n] : blobs.as<bytes_type, std::optional<bytes_type>>()) {
+        FSL_CHECK(b == expected);
+        FSL_CHECK(not n);
+    }
+
+    cnx.exec("CREATE TEMPORARY TABLE blobs (id int PRIMARY KEY, data bytea)");
+    cnx.exec(
+            "INSERT INTO blobs VALUES "
+            "(1, decode(repeat('0123456789', 250), 'escape')), (2, NULL)");
+    fostlib::json keys;
+    fostlib::insert(keys, "id", 1);
+    std::string read;
+    std::size_t chunks{};
+    FSL_CHECK_EQ(
+            cnx.read_bytes(
+                    "blobs", "data", keys,
+                    [&](std::string_view chunk) {
+                        ++chunks;
+                        read += chunk;
+                    },
+                    1000),
+            2500u);
+    FSL_CHECK_EQ(chunks, 3u);
+    std::string written;
+    for (int n{}; n != 250; ++n) { written += "0123456789"; }
+    FSL_CHECK(read == written);
+    fostlib::json null_data;
+    fostlib::insert(null_data, "id", 2);
+    FSL_CHECK_EQ(
+            cnx.read_bytes(
+                    "blobs", "data", null_data, [](std::string_view) {}),
+            0u);
+    /// Chunks from different rows must never be mixed together
+    FSL_CHECK_EXCEPTION(
+            cnx.read_bytes(
+                    "blobs", "data", fostlib::json::object_t(),
+                    [](std::string_view) {}),
+            fostlib::exceptions::out_of_range<std::size_t> &);
+}
+
+
+FSL_TEST_FUNCTION(json_documents) {
+    fostlib::pg::connection cnx;
+    const std::string doc =
+            R"({"s": "tab\there \"é\ud83d\ude00\"", )"
+            R"("n": [1, -2.5, 1e3, 12345678901234], "o": {"t": true, )"
+            R"("f": false, "z": null, "e": {}, "a": []}})";
+    const auto expected = fostlib::json::parse(fostlib::string(doc));
+    auto rs = cnx.exec(
+            "SELECT '" + doc + "'::json, '" + doc + "'::jsonb");
+    auto row = *rs.begin();
+    FSL_CHECK_EQ(row[0], expected);
+    FSL_CHECK_EQ(row[1], expected);
+    FSL_CHECK_EQ(
+            row[0]["s"],
+            fostlib::json("tab\there \"\xc3\xa9\xf0\x9f\x98\x80\""));
+    FSL_CHECK_EQ(std::string(row.raw(0).value()), doc);
+
+    auto raw = cnx.exec("SELECT '" + doc + "'::json");
+    for (const auto [forward] : raw.as<fostlib::pg::raw_json>()) {
+        FSL_CHECK_EQ(
+                fostlib::json::parse(
+                        fostlib::string(std::string(forward.text))),
+                expected);
+    }
+}
+
+
+FSL_TEST_FUNCTION(named_fields) {
+    fostlib::pg::connection cnx;
+    auto rs = cnx.exec("SELECT 1 AS one, 'two' AS two, 3 AS one");
+    FSL_CHECK_EQ(rs.index_of("two"), 1u);
+    FSL_CHECK_EQ(rs.index_of("one"), 0u);
+    FSL_CHECK_EXCEPTION(rs.index_of("three"), fostlib::exceptions::null &);
+    const auto row = *rs.begin();
+    FSL_CHECK_EQ(row["one"], fostlib::json(1));
+    FSL_CHECK_EQ(row[fostlib::string("two")], fostlib::json("two"));
+    FSL_CHECK_EQ(row[2], fostlib::json(3));
+    FSL_CHECK_EXCEPTION(row["three"], fostlib::exceptions::null &);
+}
+
+
+FSL_TEST_FUNCTION(transaction_kinds) {
+    auto setting = [](fostlib::pg::connection &cnx, const char *name) {
+        return (*cnx.exec(std::string("SHOW ") + name).begin())[0];
+    };
+    fostlib::pg::connection serializable;
+    FSL_CHECK_EQ(
+            setting(serializable, "transaction_isolation"),
+            fostlib::json("serializable"));
+
+    fostlib::json config;
+    fostlib::insert(config, "transaction", "isolation", "read committed");
+    fostlib::insert(config, "transaction", "read_only", true);
+    fostlib::pg::connection reader(config);
+    FSL_CHECK_EQ(reader.configuration()["transaction"], config["transaction"]);
+    FSL_CHECK_EQ(
+            setting(reader, "transaction_isolation"),
+            fostlib::json("read committed"));
+    FSL_CHECK_EQ(setting(reader, "transaction_read_only"), fostlib::json("on"));
+    reader.commit();
+    FSL_CHECK_EQ(setting(reader, "transaction_read_only"), fostlib::json("on"));
+    FSL_CHECK_EXCEPTION(
+            reader.exec("CREATE TEMPORARY TABLE read_only (id int)"),
+            std::exception &);
+
+    fostlib::json none;
+    fostlib::insert(none, "transaction", "isolation", "none");
+    fostlib::pg::connection autocommit(none);
+    const auto first = (*autocommit.exec("SELECT txid_current()").begin())[0];
+    const auto second = (*autocommit.exec("SELECT txid_current()").begin())[0];
+    FSL_CHECK(first != second);
+    std::size_t rows{};
+    for (const auto &row : autocommit.stream("SELECT 1", 1)) {
+        rows += row.size();
+    }
+    FSL_CHECK_EQ(rows, 1u);
+    /// An abandoned stream doesn't leave its cursor open on the session
+    {
+        auto partial =
+                autocommit.stream("SELECT * FROM generate_series(1, 3)", 1);
+        for (const auto &row : partial) {
+            FSL_CHECK_EQ(row.size(), 1u);
+            break;
+        }
+    }
+    autocommit.commit();
+    FSL_CHECK_EQ(
+            (*autocommit.exec("SELECT count(*) FROM pg_cursors").begin())[0],
+            fostlib::json(0));
+
+    fostlib::json bad;
+    fostlib::insert(bad, "transaction", "isolation", "snapshot");
+    FSL_CHECK_EXCEPTION(
+            fostlib::pg::connection{bad}, fostlib::exceptions::parse_error &);
+}
+
+
+FSL_TEST_FUNCTION(transact_retries_serialization_failures) {
+    fostlib::pg::connection setup;
+    setup.exec("DROP TABLE IF EXISTS fost_pg_transact");
+    setup.exec("CREATE TABLE fost_pg_transact (id int)");
+    setup.commit();
+
+    fostlib::pg::connection cnx, other;
+    std::size_t attempts{};
+    cnx.transact(
+            [&](fostlib::pg::connection &c) {
+                c.exec("SELECT count(*) FROM fost_pg_transact");
+                if (++attempts == 1) {
+                    /// A concurrent write skew makes the first attempt fail
+                    other.exec("SELECT count(*) FROM fost_pg_transact");
+                    other.exec("INSERT INTO fost_pg_transact VALUES (1)");
+                    other.commit();
+                }
+                c.exec("INSERT INTO fost_pg_transact VALUES (2)");
+            },
+            fostlib::pg::retry_policy{3, std::chrono::milliseconds{1}});
+    FSL_CHECK_EQ(attempts, 2u);
+    FSL_CHECK_EQ(
+            (*setup.exec("SELECT count(*) FROM fost_pg_transact").begin())[0],
+            fostlib::json(2));
+
+    FSL_CHECK_EXCEPTION(
+            cnx.transact([](fostlib::pg::connection &c) {
+                c.exec("INSERT INTO fost_pg_transact VALUES ('x')");
+            }),
+            std::exception &);
+    setup.exec("DROP TABLE fost_pg_transact");
+    setup.commit();
+}
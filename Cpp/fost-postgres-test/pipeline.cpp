@@ -0,0 +1,61 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/insert>
+#include <fost/postgres>
+#include <fost/test>
+
+
+FSL_TEST_SUITE(pipeline);
+
+
+FSL_TEST_FUNCTION(queued_commands) {
+    fostlib::pg::connection cnx;
+    cnx.exec(
+            "CREATE TEMPORARY TABLE queued_commands "
+            "(id int PRIMARY KEY, name text)");
+    cnx.exec("INSERT INTO queued_commands VALUES (1, 'it''s one'), (2, NULL)");
+    auto procedure = cnx.procedure("SELECT $1::int + $2::int");
+
+    auto queue = cnx.queue();
+    fostlib::json one, two;
+    fostlib::insert(one, "name", "it's one");
+    fostlib::insert(two, "name", fostlib::json());
+    FSL_CHECK_EQ(queue.exec("SELECT 1"), 0u);
+    FSL_CHECK_EQ(queue.select("queued_commands", one), 1u);
+    FSL_CHECK_EQ(queue.select("queued_commands", two), 2u);
+    FSL_CHECK_EQ(
+            queue.exec(procedure, {fostlib::json(3), fostlib::json(4)}), 3u);
+    FSL_CHECK_EQ(queue.size(), 4u);
+
+    auto results = queue.sync();
+    FSL_CHECK_EQ(queue.size(), 0u);
+    FSL_CHECK_EQ(results.size(), 4u);
+    FSL_CHECK_EQ((*results[0].begin())[0], fostlib::json(1));
+    FSL_CHECK_EQ((*results[1].begin())["id"], fostlib::json(1));
+    /// `name = NULL` never matches
+    FSL_CHECK(results[2].begin() == results[2].end());
+    FSL_CHECK_EQ((*results[3].begin())[0], fostlib::json(7));
+}
+
+
+FSL_TEST_FUNCTION(failure_is_attributed) {
+    fostlib::pg::connection cnx;
+    auto queue = cnx.queue();
+    queue.exec("SELECT 1");
+    queue.exec("SELECT * FROM no_such_table_here");
+    queue.exec("SELECT 3");
+    try {
+        queue.sync();
+        FSL_CHECK(false);
+    } catch (fostlib::pg::pipeline::failed &e) {
+        FSL_CHECK_EQ(e.statement, 1u);
+        FSL_CHECK_EQ(e.sql, "SELECT * FROM no_such_table_here");
+    }
+}
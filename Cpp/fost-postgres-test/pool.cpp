@@ -0,0 +1,84 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/postgres>
+#include <fost/test>
+
+
+FSL_TEST_SUITE(pool);
+
+
+FSL_TEST_FUNCTION(lease_connection) {
+    fostlib::pg::pool pool{fostlib::json()};
+    auto cnx = pool.acquire();
+    auto records = cnx->exec("SELECT 1");
+    FSL_CHECK_EQ((*records.begin())[0], fostlib::json(1));
+}
+
+
+FSL_TEST_FUNCTION(connections_are_reused) {
+    fostlib::pg::pool pool{fostlib::json()};
+    { auto cnx = pool.acquire(); }
+    const auto before = pool.statistics();
+    { auto cnx = pool.acquire(); }
+    const auto after = pool.statistics();
+    FSL_CHECK_EQ(
+            after["connections"]["created"],
+            before["connections"]["created"]);
+    FSL_CHECK_EQ(
+            fostlib::coerce<int64_t>(after["acquire"]["count"]),
+            fostlib::coerce<int64_t>(before["acquire"]["count"]) + 1);
+}
+
+
+FSL_TEST_FUNCTION(same_configuration_shares_pool) {
+    fostlib::json shared;
+    fostlib::insert(shared, "transaction", "isolation", "read committed");
+    fostlib::json conf = shared;
+    fostlib::insert(conf, "pool", "max", 3);
+    fostlib::pg::pool p1{conf}, p2{shared};
+    { auto cnx = p1.acquire(); }
+    FSL_CHECK_EQ(p1.statistics(), p2.statistics());
+
+    fostlib::json conflicting = shared;
+    fostlib::insert(conflicting, "pool", "max", 4);
+    FSL_CHECK_EXCEPTION(
+            fostlib::pg::pool{conflicting},
+            fostlib::exceptions::not_implemented &);
+}
+
+
+FSL_TEST_FUNCTION(uncommitted_work_is_rolled_back) {
+    fostlib::pg::pool pool{fostlib::json()};
+    {
+        auto cnx = pool.acquire();
+        cnx->exec("CREATE TEMPORARY TABLE pool_rollback (id int)");
+    }
+    auto cnx = pool.acquire();
+    auto records = cnx->exec(
+            "SELECT count(*) FROM pg_tables WHERE tablename='pool_rollback'");
+    FSL_CHECK_EQ((*records.begin())[0], fostlib::json(0));
+}
+
+
+FSL_TEST_FUNCTION(session_is_reset) {
+    fostlib::pg::pool pool{fostlib::json()};
+    {
+        auto cnx = pool.acquire();
+        cnx->exec("SET application_name = 'fost-pool-test'");
+        cnx->exec("CREATE TEMPORARY TABLE pool_reset (id int)");
+        cnx->commit();
+    }
+    auto cnx = pool.acquire();
+    auto setting = cnx->exec("SELECT current_setting('application_name')");
+    FSL_CHECK((*setting.begin())[0] != fostlib::json("fost-pool-test"));
+    auto tables = cnx->exec(
+            "SELECT count(*) FROM pg_tables WHERE tablename='pool_reset'");
+    FSL_CHECK_EQ((*tables.begin())[0], fostlib::json(0));
+}
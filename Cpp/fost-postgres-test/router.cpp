@@ -0,0 +1,62 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "fost-postgres-test.hpp"
+#include <fost/insert>
+#include <fost/postgres>
+#include <fost/test>
+
+
+FSL_TEST_SUITE(router);
+
+
+FSL_TEST_FUNCTION(reads_go_to_replicas) {
+    /// The same database stands in for the primary and the replica. The
+    /// replica's read only transactions keep its pool apart
+    fostlib::json config;
+    fostlib::insert(config, "primary", fostlib::json::object_t());
+    fostlib::jcursor("replicas").push_back(
+            config, fostlib::json(fostlib::json::object_t()));
+    fostlib::insert(config, "max_lag", 60);
+    fostlib::pg::router router(config);
+
+    FSL_CHECK_EQ(
+            (*router.exec("SELECT 1").begin())[0], fostlib::json(1));
+    {
+        auto reader = router.reader();
+        FSL_CHECK_EXCEPTION(
+                reader->exec("CREATE TEMPORARY TABLE router_read (id int)"),
+                std::exception &);
+    }
+    {
+        auto writer = router.writer();
+        writer->exec("CREATE TEMPORARY TABLE router_write (id int)");
+    }
+    const auto stats = router.statistics();
+    FSL_CHECK_EQ(stats["replicas"][0]["reads"], fostlib::json(2));
+    FSL_CHECK_EQ(stats["primary"]["reads"], fostlib::json(0));
+    FSL_CHECK(not stats["replicas"][0]["lag"].isnull());
+}
+
+
+FSL_TEST_FUNCTION(primary_reads_are_read_only) {
+    fostlib::json config;
+    fostlib::insert(config, "primary", fostlib::json::object_t());
+    fostlib::insert(config, "replicas", fostlib::json::array_t());
+    fostlib::pg::router router(config);
+
+    {
+        auto reader = router.reader();
+        FSL_CHECK_EQ(
+                (*reader->exec("SELECT 1").begin())[0], fostlib::json(1));
+        FSL_CHECK_EXCEPTION(
+                reader->exec("CREATE TEMPORARY TABLE router_read (id int)"),
+                std::exception &);
+    }
+    FSL_CHECK_EQ(router.statistics()["primary"]["reads"], fostlib::json(1));
+}
@@ -0,0 +1,162 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "cache.hpp"
+
+#include <fost/insert>
+
+#include <map>
+
+
+namespace {
+
+
+    template<typename T>
+    T option(const fostlib::json &conf, const char *key, T dflt) {
+        if (conf.has_key(key)) {
+            return fostlib::coerce<T>(conf[key]);
+        } else {
+            return dflt;
+        }
+    }
+
+
+    /// An estimate of the memory held by the results
+    std::size_t size_of(const std::string &key, const pqxx::result &result) {
+        std::size_t bytes = 256 + 2 * key.size();
+        for (const auto &row : result) {
+            for (const auto &field : row) { bytes += field.size() + 16; }
+        }
+        return bytes;
+    }
+
+
+}
+
+
+fostlib::pg::result_cache::result_cache(const json &conf)
+: ttl(std::chrono::duration_cast<clock_type::duration>(
+        std::chrono::duration<double>(option<double>(conf, "ttl", 60)))),
+  capacity(std::max<int64_t>(option<int64_t>(conf, "bytes", 16 << 20), 0)) {}
+
+
+std::shared_ptr<fostlib::pg::result_cache>
+        fostlib::pg::result_cache::shared(const json &conf) {
+    if (not conf.has_key("cache") || conf["cache"].isnull()
+        || conf["cache"] == json(false)) {
+        return {};
+    }
+    static std::mutex mutex;
+    static std::map<string, std::shared_ptr<result_cache>> caches;
+    const auto key = json::unparse(conf, false);
+    std::lock_guard<std::mutex> lock{mutex};
+    auto &c = caches[key];
+    if (not c) {
+        c = std::make_shared<result_cache>(
+                conf["cache"].isobject() ? conf["cache"] : json{});
+    }
+    return c;
+}
+
+
+bool fostlib::pg::result_cache::current(const entry &e) const {
+    if (e.issued < everything) { return false; }
+    auto found = invalidated.find(e.relation);
+    return found == invalidated.end() || e.issued >= found->second;
+}
+
+
+void fostlib::pg::result_cache::remove(std::list<entry>::iterator e) {
+    bytes -= e->bytes;
+    index.erase(e->key);
+    entries.erase(e);
+}
+
+
+std::optional<pqxx::result>
+        fostlib::pg::result_cache::find(const std::string &key) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto found = index.find(key);
+    if (found == index.end()) {
+        ++misses;
+        return {};
+    }
+    const auto e = found->second;
+    if (e->expires < clock_type::now() || not current(*e)) {
+        ++stale;
+        ++misses;
+        remove(e);
+        return {};
+    }
+    ++hits;
+    entries.splice(entries.begin(), entries, e);
+    return e->result;
+}
+
+
+fostlib::pg::result_cache::ticket fostlib::pg::result_cache::issue() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return version;
+}
+
+
+void fostlib::pg::result_cache::store(
+        const std::string &key,
+        const std::string &relation,
+        ticket issued,
+        const pqxx::result &result) {
+    const auto size = size_of(key, result);
+    if (size > capacity) { return; }
+    const auto expires = clock_type::now() + ttl;
+    std::lock_guard<std::mutex> lock{mutex};
+    entry e{key, relation, result, size, issued, expires};
+    if (not current(e)) { return; }
+    if (auto found = index.find(key); found != index.end()) {
+        remove(found->second);
+    }
+    entries.push_front(std::move(e));
+    index[key] = entries.begin();
+    bytes += size;
+    ++stored;
+    while (bytes > capacity) {
+        remove(std::prev(entries.end()));
+        ++evictions;
+    }
+}
+
+
+void fostlib::pg::result_cache::invalidate(const std::string &relation) {
+    std::lock_guard<std::mutex> lock{mutex};
+    invalidated[relation] = ++version;
+    ++invalidations;
+}
+
+
+void fostlib::pg::result_cache::invalidate() {
+    std::lock_guard<std::mutex> lock{mutex};
+    everything = ++version;
+    invalidated.clear();
+    ++invalidations;
+}
+
+
+fostlib::json fostlib::pg::result_cache::statistics() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    json stats;
+    insert(stats, "ttl", std::chrono::duration<double>(ttl).count());
+    insert(stats, "entries", int64_t(entries.size()));
+    insert(stats, "bytes", int64_t(bytes));
+    insert(stats, "capacity", int64_t(capacity));
+    insert(stats, "hits", hits);
+    insert(stats, "misses", misses);
+    insert(stats, "stored", stored);
+    insert(stats, "stale", stale);
+    insert(stats, "evictions", evictions);
+    insert(stats, "invalidations", invalidations);
+    return stats;
+}
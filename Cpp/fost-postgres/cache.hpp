@@ -0,0 +1,95 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+#include <pqxx/result>
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// Query results kept for repeated reads, shared by all of the
+        /// connections with the same configuration. Results expire after
+        /// the TTL, and the least recently used are dropped to keep within
+        /// the memory cap. The results are the `pqxx::result`, which is
+        /// reference counted, so handing them out doesn't copy them.
+        class result_cache {
+          public:
+            using clock_type = std::chrono::steady_clock;
+
+            /// Taken before a query is run and given back when storing its
+            /// results. Results are only stored if nothing invalidated
+            /// their relation while the query was running.
+            using ticket = int64_t;
+
+            const clock_type::duration ttl;
+            const std::size_t capacity;
+
+            /// Takes the `cache` part of the connection configuration
+            result_cache(const json &);
+
+            /// The cache for a connection configuration, or null if the
+            /// configuration doesn't ask for one
+            static std::shared_ptr<result_cache> shared(const json &);
+
+            std::optional<pqxx::result> find(const std::string &key);
+            ticket issue() const;
+            /// Store the results for the key. Results for an empty relation
+            /// are only invalidated by invalidating everything.
+            void store(
+                    const std::string &key,
+                    const std::string &relation,
+                    ticket,
+                    const pqxx::result &);
+
+            void invalidate(const std::string &relation);
+            void invalidate();
+
+            json statistics() const;
+
+          private:
+            struct entry {
+                std::string key, relation;
+                pqxx::result result;
+                std::size_t bytes;
+                ticket issued;
+                clock_type::time_point expires;
+            };
+            mutable std::mutex mutex;
+            /// Most recently used at the front
+            std::list<entry> entries;
+            std::unordered_map<std::string, std::list<entry>::iterator> index;
+            std::size_t bytes = 0;
+            /// Incremented for every invalidation. The relations map to the
+            /// value at their last invalidation
+            ticket version = 0, everything = 0;
+            std::unordered_map<std::string, ticket> invalidated;
+            int64_t hits = 0, misses = 0, stored = 0, stale = 0,
+                    evictions = 0, invalidations = 0;
+
+            bool current(const entry &) const;
+            void remove(std::list<entry>::iterator);
+        };
+
+
+    }
+
+
+}
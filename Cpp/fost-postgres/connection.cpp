@@ -7,39 +7,42 @@
 
 
 #include <fost/pg/connection.hpp>
+#include <fost/pg/decoder.hpp>
 #include <fost/pg/recordset.hpp>
 #include <fost/pg/stored-procedure.hpp>
 #include "connection.hpp"
+#include "recordset.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <fost/exception/out_of_range.hpp>
+#include <fost/exception/parse_error.hpp>
 #include <fost/insert>
 #include <fost/log>
-#include <pqxx/nontransaction>
+#include <pqxx/except>
 
 
 const fostlib::module fostlib::pg::c_fost_pg(c_fost, "pg");
 
 
-namespace {
-
-
-    std::pair<fostlib::utf8_string, fostlib::json>
-            dsn_from_json(const fostlib::json &conf) {
-        fostlib::utf8_string dsn;
-        fostlib::json effective;
-        for (auto &key : {"host", "dbname", "password", "user"}) {
-            if (conf.has_key(key)) {
-                fostlib::insert(effective, key, conf[key]);
-                dsn += fostlib::utf8_string(key) + "='"
-                        + fostlib::coerce<fostlib::utf8_string>(
-                                fostlib::coerce<fostlib::string>(conf[key]))
-                        + "' ";
-            }
+std::pair<fostlib::utf8_string, fostlib::json>
+        fostlib::pg::dsn_from_json(const json &conf) {
+    utf8_string dsn;
+    json effective;
+    for (auto &key : {"host", "dbname", "password", "user"}) {
+        if (conf.has_key(key)) {
+            insert(effective, key, conf[key]);
+            dsn += utf8_string(key) + "='"
+                    + coerce<utf8_string>(coerce<string>(conf[key])) + "' ";
         }
-        return std::make_pair(dsn, effective);
     }
-
-
+    for (auto &key : {"transaction", "cache"}) {
+        if (conf.has_key(key)) { insert(effective, key, conf[key]); }
+    }
+    return std::make_pair(dsn, effective);
 }
 
 
@@ -57,6 +60,17 @@ void fostlib::pg::dropdb(const json &dsn, const string &dbname) {
 }
 
 
+std::optional<std::string> fostlib::pg::parameter(const json &val) {
+    if (val.isnull()) {
+        return {};
+    } else if (not val.isatom()) {
+        return static_cast<std::string>(json::unparse(val, false));
+    } else {
+        return static_cast<std::string>(coerce<string>(val));
+    }
+}
+
+
 /*
     fostlib::pg::connection
 */
@@ -96,13 +110,156 @@ fostlib::pg::recordset fostlib::pg::connection::exec(const utf8_string &sql) {
 
 
 void fostlib::pg::connection::commit() {
+    /// An error in a command whose results haven't been read would
+    /// otherwise go unnoticed
+    if (pimpl->in_flight_count) {
+        throw std::logic_error(
+                "The transaction can't be committed until the results of "
+                "all asynchronous commands have been read");
+    }
     pimpl->trans->commit();
-    pimpl->trans = std::make_unique<impl::transaction_type>(pimpl->pqcnx);
+    ++pimpl->transaction_number;
+    for (const auto &relation : pimpl->written) {
+        pimpl->cache->invalidate(relation);
+    }
+    pimpl->written.clear();
+    pimpl->trans = pimpl->begin();
+}
+
+
+void fostlib::pg::connection::rollback() {
+    pimpl->abandon_in_flight();
+    pimpl->trans->abort();
+    ++pimpl->transaction_number;
+    pimpl->written.clear();
+    pimpl->trans = pimpl->begin();
+}
+
+
+fostlib::pg::connection &
+        fostlib::pg::connection::invalidate(const char *relation) {
+    if (pimpl->cache) { pimpl->cache->invalidate(relation); }
+    return *this;
+}
+fostlib::pg::connection &fostlib::pg::connection::invalidate() {
+    if (pimpl->cache) { pimpl->cache->invalidate(); }
+    return *this;
+}
+
+
+fostlib::pg::result_cache::ticket
+        fostlib::pg::connection::impl::cache_ticket() const {
+    /// Without a transaction each command has its own snapshot
+    if (level == isolation::none) {
+        return cache->issue();
+    } else {
+        return transaction_ticket;
+    }
+}
+
+
+void fostlib::pg::connection::impl::wrote(const char *relation) {
+    if (cache) {
+        cache->invalidate(relation);
+        if (level != isolation::none) { written.insert(relation); }
+    }
+}
+
+
+void fostlib::pg::connection::transact(
+        const std::function<void(connection &)> &fn,
+        const retry_policy &policy) {
+    const auto started = std::chrono::steady_clock::now();
+    auto seconds = [started]() {
+        return std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                .count();
+    };
+    auto abandon = [this]() {
+        try {
+            rollback();
+        } catch (std::exception &e) {
+            fostlib::log::warning(c_fost_pg)(
+                    "", "Error rolling back failed transaction")(
+                    "exception", "what", e.what());
+        }
+    };
+    rollback();
+    auto backoff = policy.backoff;
+    for (std::size_t attempt{1};; ++attempt) {
+        try {
+            fn(*this);
+            commit();
+            if (attempt > 1) {
+                fostlib::log::info(c_fost_pg)(
+                        "", "Transaction committed after retries")(
+                        "retries", int64_t(attempt - 1))("seconds", seconds());
+            }
+            return;
+        } catch (pqxx::sql_error &e) {
+            abandon();
+            const auto &state = e.sqlstate();
+            if (state != "40001" && state != "40P01") { throw; }
+            if (attempt >= policy.attempts) {
+                fostlib::log::error(c_fost_pg)(
+                        "", "Transaction failed after retries")(
+                        "sqlstate", state.c_str())(
+                        "retries", int64_t(attempt - 1))("seconds", seconds());
+                throw;
+            }
+            thread_local std::mt19937 random{std::random_device{}()};
+            const auto delay = std::chrono::milliseconds{
+                    std::uniform_int_distribution<int64_t>{
+                            0, std::max<int64_t>(backoff.count(), 0)}(random)};
+            fostlib::log::warning(c_fost_pg)("", "Retrying transaction")(
+                    "sqlstate", state.c_str())("attempt", int64_t(attempt))(
+                    "delay", delay.count() / 1000.0);
+            std::this_thread::sleep_for(delay);
+            backoff = std::min(backoff * 2, policy.max_backoff);
+        } catch (...) {
+            abandon();
+            throw;
+        }
+    }
 }
 
 
 namespace {
 
+    const fostlib::setting<int64_t> c_statement_cache(
+            "fost-postgres/connection.cpp",
+            "Postgres",
+            "Prepared statement cache size",
+            64,
+            true);
+    const fostlib::setting<int64_t> c_batch_rows(
+            "fost-postgres/connection.cpp",
+            "Postgres",
+            "Maximum rows in a batch",
+            1000,
+            true);
+    const fostlib::setting<int64_t> c_select_keys(
+            "fost-postgres/connection.cpp",
+            "Postgres",
+            "Maximum keys in a select",
+            10000,
+            true);
+    /// The protocol limits the number of parameters a statement can have
+    constexpr std::size_t c_max_parameters = 65535;
+
+    template<typename F>
+    auto logged(const fostlib::string &sql, F f) -> decltype(f()) {
+        try {
+            return f();
+        } catch (std::exception &e) {
+            fostlib::log::error(fostlib::pg::c_fost_pg)(
+                    "", "Error executing SQL command")("sql", sql)(
+                    "exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+            throw;
+        }
+    }
+
     inline fostlib::string column(const fostlib::json &name) {
         return fostlib::coerce<fostlib::string>(name);
     }
@@ -121,33 +278,26 @@ namespace {
         return columns(fostlib::string(), def);
     }
 
-    template<typename T>
-    fostlib::string value(T &t, fostlib::json const &val) {
-        if (val.isnull()) {
-            return "NULL";
-        } else if (not val.isatom()) {
-            return t.quote(static_cast<std::string>(
-                    fostlib::json::unparse(val, false)));
-        } else {
-            return t.quote(static_cast<std::string>(
-                    fostlib::coerce<fostlib::string>(val)));
-        }
+    using parameters = std::vector<std::optional<std::string>>;
+
+    /// Bind the value as the next parameter and return its placeholder
+    fostlib::string value(parameters &args, fostlib::json const &val) {
+        args.push_back(fostlib::pg::parameter(val));
+        return "$" + fostlib::coerce<fostlib::string>(int64_t(args.size()));
     }
-    template<typename T>
-    fostlib::string
-            value_string(T &t, fostlib::string vals, const fostlib::json &def) {
+    fostlib::string value_string(
+            parameters &args, fostlib::string vals, const fostlib::json &def) {
         for (const auto &val : def) {
             if (vals.empty()) {
-                vals = value(t, val);
+                vals = value(args, val);
             } else {
-                vals += ", " + value(t, val);
+                vals += ", " + value(args, val);
             }
         }
         return vals;
     }
-    template<typename T>
-    fostlib::string value_string(T &t, const fostlib::json &def) {
-        return value_string(t, fostlib::string(), def);
+    fostlib::string value_string(parameters &args, const fostlib::json &def) {
+        return value_string(args, fostlib::string(), def);
     }
 
     fostlib::string
@@ -162,7 +312,429 @@ namespace {
         }
         return ret_vals;
     }
+    fostlib::string
+            returning_clause(const std::vector<fostlib::string> &returning) {
+        if (returning.size()) {
+            return " RETURNING " + returning_vals(returning);
+        } else {
+            return fostlib::string();
+        }
+    }
+
+    /// An array literal holding the `index`th value of each of the keys
+    std::string array_literal(
+            std::vector<std::vector<std::string>>::const_iterator begin,
+            std::vector<std::vector<std::string>>::const_iterator end,
+            std::size_t index) {
+        std::string literal = "{";
+        for (auto key = begin; key != end; ++key) {
+            if (key != begin) { literal += ','; }
+            literal += '"';
+            for (const char c : (*key)[index]) {
+                if (c == '"' || c == '\\') { literal += '\\'; }
+                literal += c;
+            }
+            literal += '"';
+        }
+        return literal + "}";
+    }
+
+    /// Build multi-row INSERT statements for the rows. Consecutive rows
+    /// with the same columns are chunked together so that no statement
+    /// goes over the batch size or parameter limits. The SQL from `clauses`
+    /// is appended to the VALUES list. `execute` is given each statement,
+    /// its arguments and whether the chunk is full sized (and so the
+    /// statement shape is likely to be seen again).
+    template<typename C, typename E>
+    void batches(
+            const char *relation,
+            const std::vector<fostlib::json> &rows,
+            C clauses,
+            E execute) {
+        for (auto start = rows.begin(); start != rows.end();) {
+            const auto &first = *start;
+            const auto names = columns(first);
+            const std::size_t chunk = std::max<std::size_t>(
+                    1u,
+                    std::min<std::size_t>(
+                            c_max_parameters
+                                    / std::max<std::size_t>(first.size(), 1u),
+                            std::max<int64_t>(c_batch_rows.value(), 1)));
+            parameters args;
+            fostlib::string values;
+            std::size_t count{};
+            for (; start != rows.end() && count < chunk
+                 && columns(*start) == names;
+                 ++start, ++count) {
+                if (count) { values += ", "; }
+                values += "(" + value_string(args, *start) + ")";
+            }
+            execute(fostlib::string("INSERT INTO ") + relation + " (" + names
+                            + ") VALUES " + values + clauses(first),
+                    args, count == chunk);
+        }
+    }
+
+}
+
+
+fostlib::string fostlib::pg::literal(
+        pqxx::transaction_base &trans, const json &val) {
+    if (auto p = parameter(val); p) {
+        return trans.quote(*p);
+    } else {
+        return "NULL";
+    }
+}
+
+
+std::string fostlib::pg::execute_sql(
+        pqxx::transaction_base &trans,
+        const std::string &name,
+        const std::vector<json> &args) {
+    std::string sql = "EXECUTE " + trans.quote_name(name);
+    for (std::size_t index{}; index != args.size(); ++index) {
+        sql += index ? ", " : " (";
+        sql += static_cast<std::string>(literal(trans, args[index]));
+    }
+    if (not args.empty()) { sql += ")"; }
+    return sql;
+}
+
+
+namespace {
+    template<pqxx::isolation_level L>
+    std::unique_ptr<pqxx::transaction_base>
+            start(pqxx::connection &cnx, bool read_only, bool deferrable) {
+        std::unique_ptr<pqxx::transaction_base> trans;
+        if (read_only) {
+            trans = std::make_unique<
+                    pqxx::transaction<L, pqxx::write_policy::read_only>>(cnx);
+        } else {
+            trans = std::make_unique<pqxx::transaction<L>>(cnx);
+        }
+        /// Only has an effect on serializable read only transactions
+        if (deferrable) { trans->exec("SET TRANSACTION DEFERRABLE"); }
+        return trans;
+    }
+}
+
+
+fostlib::pg::connection::impl::impl(const fostlib::utf8_string &dsn)
+: pqcnx(static_cast<std::string>(dsn)),
+  configuration(dsn),
+  statement_capacity(std::max<int64_t>(c_statement_cache.value(), 0)),
+  recording(query_metrics::enabled()),
+  slow_query(query_metrics::slow_query()) {
+    trans = begin();
+}
+
+
+fostlib::pg::connection::impl::impl(
+        const std::pair<fostlib::utf8_string, fostlib::json> &dsn)
+: pqcnx(static_cast<std::string>(dsn.first)),
+  configuration(dsn.second),
+  statement_capacity(std::max<int64_t>(c_statement_cache.value(), 0)),
+  cache(result_cache::shared(configuration)),
+  recording(query_metrics::enabled()),
+  slow_query(query_metrics::slow_query()) {
+    if (configuration.has_key("transaction")) {
+        const auto &options = configuration["transaction"];
+        if (options.has_key("isolation")) {
+            const auto name = coerce<string>(options["isolation"]);
+            if (name == "none") {
+                level = isolation::none;
+            } else if (name == "read committed") {
+                level = isolation::read_committed;
+            } else if (name == "repeatable read") {
+                level = isolation::repeatable_read;
+            } else if (name == "serializable") {
+                level = isolation::serializable;
+            } else {
+                throw exceptions::parse_error(
+                        "Unknown transaction isolation level",
+                        static_cast<std::string>(name));
+            }
+        }
+        if (options.has_key("read_only")) {
+            read_only = coerce<bool>(options["read_only"]);
+        }
+        if (options.has_key("deferrable")) {
+            deferrable = coerce<bool>(options["deferrable"]);
+        }
+    }
+    trans = begin();
+}
+
+
+const std::string &fostlib::pg::connection::impl::column_type(
+        const std::string &relation, const std::string &column) {
+    auto &type = column_types[relation + "." + column];
+    if (type.empty()) {
+        const auto found = exec_cached(
+                "SELECT format_type(atttypid, atttypmod) FROM pg_attribute "
+                "WHERE attrelid = $1::regclass AND attname = $2 "
+                "AND attnum > 0 AND NOT attisdropped",
+                {relation, column});
+        if (found.empty()) {
+            throw exceptions::null(
+                    "There is no column with this name",
+                    string(relation + "." + column));
+        }
+        type = found[0][0].c_str();
+    }
+    return type;
+}
+
+
+std::unique_ptr<pqxx::transaction_base> fostlib::pg::connection::impl::begin() {
+    /// Taken before the transaction so that its snapshot can't be older
+    if (cache) { transaction_ticket = cache->issue(); }
+    switch (level) {
+    case isolation::none: return std::make_unique<pqxx::nontransaction>(pqcnx);
+    case isolation::read_committed:
+        return start<pqxx::read_committed>(pqcnx, read_only, deferrable);
+    case isolation::repeatable_read:
+        return start<pqxx::repeatable_read>(pqcnx, read_only, deferrable);
+    case isolation::serializable:
+    default: return start<pqxx::serializable>(pqcnx, read_only, deferrable);
+    }
+}
+
+
+pqxx::result fostlib::pg::connection::impl::exec_cached(
+        const std::string &sql,
+        const std::vector<std::optional<std::string>> &args) {
+    /// With no room in the cache nothing is prepared
+    if (not statement_capacity) { return exec_params(sql, args); }
+    return measured(sql, [&]() {
+        std::string name;
+        auto found = statement_index.find(sql);
+        if (found != statement_index.end()) {
+            ++statement_hits;
+            statements.splice(statements.begin(), statements, found->second);
+            name = found->second->second;
+        } else {
+            ++statement_misses;
+            /// Make room first so the new statement is never evicted
+            while (statements.size() >= statement_capacity) {
+                pqcnx.unprepare(statements.back().second);
+                statement_index.erase(statements.back().first);
+                statements.pop_back();
+                ++statement_evictions;
+            }
+            static std::atomic<unsigned int> number;
+            name = "sp_shape_" + std::to_string(++number);
+            preparing = prepare(name, sql);
+            statements.emplace_front(sql, name);
+            statement_index[sql] = statements.begin();
+        }
+        return exec_prepared(name, args, [](auto &arg) {
+            return arg.has_value() ? arg.value().c_str() : nullptr;
+        });
+    });
+}
+
+
+pqxx::result fostlib::pg::connection::impl::exec_params(
+        const std::string &sql,
+        const std::vector<std::optional<std::string>> &args) {
+    return measured(sql, [&]() {
+        return trans->exec_params(
+                sql, pqxx::prepare::make_dynamic_params(args, [](auto &arg) {
+                    return arg.has_value() ? arg.value().c_str() : nullptr;
+                }));
+    });
+}
+
+
+double fostlib::pg::connection::impl::prepare(
+        const std::string &name, const std::string &sql) {
+    const auto started = std::chrono::steady_clock::now();
+    pqcnx.prepare(name, sql);
+    const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - started)
+                                   .count();
+    if (recording) {
+        metrics.prepared(seconds);
+        query_metrics::process().prepared(seconds);
+    }
+    return seconds;
+}
+
+
+void fostlib::pg::connection::impl::executed(
+        const std::string &sql, double seconds, const pqxx::result &result) {
+    const bool slow = slow_query > 0 && seconds >= slow_query;
+    if (not recording && not slow) {
+        preparing = 0;
+        return;
+    }
+    int64_t bytes{};
+    for (const auto &row : result) {
+        for (const auto &field : row) { bytes += field.size(); }
+    }
+    const int64_t rows = result.size();
+    if (recording) {
+        metrics.executed(sql, seconds, rows, bytes);
+        query_metrics::process().executed(sql, seconds, rows, bytes);
+    }
+    if (slow) {
+        fostlib::log::warning(c_fost_pg)("", "Slow SQL command")(
+                "sql", sql.c_str())("seconds", "total", seconds)(
+                "seconds", "prepare", preparing)(
+                "seconds", "execute", seconds - preparing)("rows", rows)(
+                "bytes", bytes);
+    }
+    preparing = 0;
+}
+
+
+fostlib::pg::recordset fostlib::pg::connection::exec_cached(
+        const string &sql,
+        const std::vector<std::optional<std::string>> &args) {
+    return logged(sql, [&]() {
+        return recordset(std::make_unique<recordset::impl>(
+                pimpl->exec_cached(static_cast<std::string>(sql), args)));
+    });
+}
+
+
+namespace {
+
+    /// True if the session shows values the way the binary decoders give
+    /// them: time stamps with a time zone in UTC, summer and winter, the
+    /// ISO date style and `bytea` in hex
+    const char *const c_binary_session =
+            "SELECT '2000-01-01 00:00Z'::timestamptz::text LIKE '%+00' "
+            "AND '2000-07-01 00:00Z'::timestamptz::text LIKE '%+00' "
+            "AND current_setting('DateStyle') LIKE 'ISO%' "
+            "AND current_setting('bytea_output') = 'hex'";
+
+    /// True if decoding the binary results gives the same JSON as the
+    /// text format would
+    bool same_as_text(const pqxx::result &description, bool session) {
+        for (pqxx::row::size_type index{}; index != description.columns();
+             ++index) {
+            const auto oid = description.column_type(index);
+            if (not fostlib::pg::decoder<fostlib::json>::accepts_binary(oid)
+                || (not session
+                    && (oid == 17 || oid == 1082 || oid == 1083
+                        || oid == 1184))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+
+bool fostlib::pg::connection::impl::binary_like_text(const std::string &query) {
+    static std::atomic<unsigned int> number;
+    const auto name = "fost_describe_" + std::to_string(++number);
+    /// `FETCH 0` gives the columns without running the query. Held cursors
+    /// are only filled in when their transaction ends, and this one is
+    /// closed before that.
+    pqxx::pipeline batch(*trans);
+    batch.retain(4);
+    const auto session = batch.insert(c_binary_session);
+    batch.insert(
+            "DECLARE " + name + " BINARY NO SCROLL CURSOR"
+            + (level == isolation::none ? " WITH HOLD" : "") + " FOR "
+            + query);
+    const auto description = batch.insert("FETCH 0 FROM " + name);
+    batch.insert("CLOSE " + name);
+    batch.complete();
+    const bool matches = batch.retrieve(session)[0][0].as<bool>();
+    return same_as_text(batch.retrieve(description), matches);
+}
+
+
+fostlib::pg::recordset fostlib::pg::connection::exec(
+        const utf8_string &sql, result_format format) {
+    if (format == result_format::text) { return exec(sql); }
+    const auto query = static_cast<std::string>(sql);
+    /// The format is chosen before the query is run, so it only ever runs
+    /// once
+    const bool binary = logged(coerce<string>(sql), [&]() {
+        return pimpl->binary_like_text(query);
+    });
+    if (not binary) { return exec(sql); }
+    static std::atomic<unsigned int> number;
+    const auto name = "fost_binary_" + std::to_string(++number);
+    /// Without a transaction the cursor has to be held open after the
+    /// statement that declares it
+    const bool hold = pimpl->level == impl::isolation::none;
+    auto results = logged(coerce<string>(sql), [&]() {
+        return pimpl->measured(query, [&]() {
+            /// The cursor is declared, read and closed in one round trip
+            pqxx::pipeline batch(*pimpl->trans);
+            batch.retain(3);
+            batch.insert(
+                    "DECLARE " + name + " BINARY NO SCROLL CURSOR"
+                    + (hold ? " WITH HOLD" : "") + " FOR " + query);
+            const auto fetch = batch.insert("FETCH ALL FROM " + name);
+            batch.insert("CLOSE " + name);
+            batch.complete();
+            return batch.retrieve(fetch);
+        });
+    });
+    return recordset(std::make_unique<recordset::impl>(
+            recordset::impl::single(std::move(results)), true));
+}
+
+
+fostlib::pg::recordset fostlib::pg::connection::stream(
+        const utf8_string &sql, std::size_t batch_rows, result_format format) {
+    return logged(coerce<string>(sql), [&]() {
+        const bool binary = format == result_format::binary
+                && pimpl->binary_like_text(static_cast<std::string>(sql));
+        return recordset(std::make_unique<recordset::impl>(
+                std::make_unique<recordset::impl::cursor>(
+                        *pimpl, sql, batch_rows, binary)));
+    });
+}
+
+
+std::vector<pqxx::result> fostlib::pg::connection::impl::exec_batches(
+        const char *relation,
+        const std::vector<json> &rows,
+        std::function<string(const json &)> clauses) {
+    std::vector<pqxx::result> results;
+    batches(relation, rows, clauses,
+            [&](const string &sql, const parameters &args, bool full) {
+                results.push_back(logged(sql, [&]() {
+                    if (full) {
+                        return exec_cached(static_cast<std::string>(sql), args);
+                    } else {
+                        return exec_params(static_cast<std::string>(sql), args);
+                    }
+                }));
+            });
+    wrote(relation);
+    return results;
+}
+
+
+fostlib::json fostlib::pg::connection::statistics() const {
+    json stats;
+    insert(stats, "statements", "cached", int64_t(pimpl->statements.size()));
+    insert(stats, "statements", "capacity",
+           int64_t(pimpl->statement_capacity));
+    insert(stats, "statements", "hits", pimpl->statement_hits);
+    insert(stats, "statements", "misses", pimpl->statement_misses);
+    insert(stats, "statements", "evictions", pimpl->statement_evictions);
+    if (pimpl->recording) {
+        insert(stats, "queries", pimpl->metrics.snapshot());
+    }
+    if (pimpl->cache) { insert(stats, "cache", pimpl->cache->statistics()); }
+    return stats;
+}
 
+
+fostlib::json fostlib::pg::connection::process_statistics() {
+    return query_metrics::process().snapshot();
 }
 
 
@@ -186,49 +758,187 @@ fostlib::pg::recordset fostlib::pg::connection::select(
 }
 fostlib::pg::recordset fostlib::pg::connection::select(
         const char *relation, const json &values, const json &order) {
-    string select = "SELECT * FROM ", where, orderby;
-    select += relation;
-    for (fostlib::json::const_iterator iter(values.begin());
-         iter != values.end(); ++iter) {
-        if (where.empty()) {
-            where = column(iter.key()) + " = " + value(*pimpl->trans, *iter);
-        } else {
-            where += " AND " + column(iter.key()) + " = "
-                    + value(*pimpl->trans, *iter);
+    parameters args;
+    const auto sql = select_sql(
+            relation, values, order,
+            [&args](const json &v) { return value(args, v); });
+    /// Results stored by other connections can't include the writes this
+    /// transaction has made to the relation
+    if (not pimpl->cache || pimpl->written.count(relation)) {
+        return exec_cached(sql, args);
+    }
+    const std::string key = "select " + std::string(relation) + "\n"
+            + static_cast<std::string>(json::unparse(values, false)) + "\n"
+            + static_cast<std::string>(json::unparse(order, false));
+    if (auto found = pimpl->cache->find(key); found) {
+        return recordset(std::make_unique<recordset::impl>(std::move(*found)));
+    }
+    const auto ticket = pimpl->cache_ticket();
+    auto result = logged(sql, [&]() {
+        return pimpl->exec_cached(static_cast<std::string>(sql), args);
+    });
+    pimpl->cache->store(key, relation, ticket, result);
+    return recordset(std::make_unique<recordset::impl>(std::move(result)));
+}
+
+
+fostlib::pg::recordset fostlib::pg::connection::scan(
+        const char *relation,
+        const json &keys,
+        const std::vector<fostlib::string> &order,
+        std::size_t page_size,
+        const std::vector<fostlib::string> &columns) {
+    if (order.empty()) {
+        throw exceptions::not_implemented(
+                __FUNCTION__, "A scan needs columns to order the rows by");
+    }
+    auto pages = std::make_unique<recordset::impl::keyset>(
+            *pimpl, relation, keys, order, page_size, columns);
+    return logged(string(pages->first), [&]() {
+        return recordset(std::make_unique<recordset::impl>(std::move(pages)));
+    });
+}
+
+
+fostlib::pg::recordset fostlib::pg::connection::select_many(
+        const char *relation,
+        const std::vector<fostlib::string> &key_columns,
+        const std::vector<json> &keys,
+        const std::vector<fostlib::string> &columns) {
+    if (key_columns.empty()) {
+        throw exceptions::not_implemented(
+                __FUNCTION__, "Selecting many rows needs the key columns");
+    }
+    std::string what, names, unnested;
+    for (const auto &column : columns) {
+        if (not what.empty()) { what += ", "; }
+        what += static_cast<std::string>(column);
+    }
+    for (std::size_t index{}; index != key_columns.size(); ++index) {
+        const auto key = static_cast<std::string>(key_columns[index]);
+        /// The keys are needed to match the rows back to them
+        if (not columns.empty()
+            && std::find(columns.begin(), columns.end(), key_columns[index])
+                    == columns.end()) {
+            what += ", " + key;
+        }
+        names += (index ? ", " : "") + key;
+        /// `= ANY` works out the type of its array, but `unnest` can't
+        if (key_columns.size() > 1) {
+            unnested += (index ? ", $" : "$") + std::to_string(index + 1)
+                    + "::" + pimpl->column_type(relation, key) + "[]";
         }
     }
-    if (not where.empty()) { select += " WHERE " + where; }
-    for (const auto &ob : order) {
-        if (orderby.empty()) {
-            orderby = " ORDER BY " + fostlib::coerce<fostlib::string>(ob);
-        } else {
-            orderby += ", " + fostlib::coerce<fostlib::string>(ob);
+    const auto sql = "SELECT " + (what.empty() ? std::string{"*"} : what)
+            + " FROM " + relation + " WHERE "
+            + (key_columns.size() == 1
+                       ? names + " = ANY($1)"
+                       : "(" + names + ") IN (SELECT * FROM unnest("
+                               + unnested + "))");
+
+    std::set<std::vector<std::string>> seen;
+    std::vector<std::vector<std::string>> tuples;
+    for (const auto &key : keys) {
+        std::vector<std::string> tuple;
+        for (const auto &column : key_columns) {
+            const auto p = parameter(
+                    key_columns.size() > 1 || key.isobject() ? key[column]
+                                                             : key);
+            /// A null never compares equal, so can't find a row
+            if (not p) { break; }
+            tuple.push_back(*p);
+        }
+        if (tuple.size() == key_columns.size() && seen.insert(tuple).second) {
+            tuples.push_back(std::move(tuple));
         }
     }
-    if (not orderby.empty()) { select += orderby; }
-    return exec(coerce<utf8_string>(select));
+
+    const std::size_t chunk = std::max<int64_t>(c_select_keys.value(), 1);
+    std::vector<pqxx::result> results;
+    for (auto start = tuples.cbegin(); start != tuples.cend();) {
+        const auto end = start
+                + std::min<std::size_t>(chunk, tuples.cend() - start);
+        parameters args;
+        for (std::size_t index{}; index != key_columns.size(); ++index) {
+            args.push_back(array_literal(start, end, index));
+        }
+        results.push_back(logged(string(sql), [&]() {
+            return pimpl->exec_cached(sql, args);
+        }));
+        start = end;
+    }
+    return recordset(std::make_unique<recordset::impl>(std::move(results)));
+}
+
+
+std::size_t fostlib::pg::connection::read_bytes(
+        const char *relation,
+        const char *column,
+        const json &keys,
+        const std::function<void(std::string_view)> &chunk,
+        std::size_t chunk_bytes) {
+    chunk_bytes = std::max<std::size_t>(chunk_bytes, 1);
+    /// The offset and length are the first two parameters so the SQL is
+    /// the same for every chunk
+    parameters args{std::string{}, std::to_string(chunk_bytes)};
+    const auto select = select_sql(
+            string("substring(") + column + " FROM $1 FOR $2)", relation,
+            keys, json::array_t(),
+            [&args](const json &v) { return value(args, v); });
+    const auto sql = static_cast<std::string>(select);
+    std::vector<unsigned char> buffer;
+    std::size_t total{};
+    while (true) {
+        args[0] = std::to_string(total + 1);
+        auto result = logged(
+                select, [&]() { return pimpl->exec_cached(sql, args); });
+        if (result.size() > 1) {
+            throw exceptions::out_of_range<std::size_t>(
+                    "The keys for read_bytes must identify a single row", 0,
+                    1, result.size());
+        } else if (result.empty() || result[0][0].is_null()) {
+            return total;
+        }
+        buffer.clear();
+        bytea_from_text(
+                std::string_view{result[0][0].c_str(), result[0][0].size()},
+                buffer);
+        if (not buffer.empty()) {
+            chunk(std::string_view{
+                    reinterpret_cast<const char *>(buffer.data()),
+                    buffer.size()});
+        }
+        total += buffer.size();
+        if (buffer.size() < chunk_bytes) { return total; }
+    }
 }
 
 
 fostlib::pg::connection &fostlib::pg::connection::insert(
         const char *relation, const json &values) {
-    exec(coerce<utf8_string>(
+    parameters args;
+    exec_cached(
             string("INSERT INTO ") + relation + " (" + columns(values)
-            + ") VALUES (" + value_string(*pimpl->trans, values) + ")"));
+                    + ") VALUES (" + value_string(args, values) + ")",
+            args);
+    pimpl->wrote(relation);
     return *this;
 }
 fostlib::pg::recordset fostlib::pg::connection::insert(
         const char *relation,
         const json &values,
         const std::vector<fostlib::string> &returning) {
+    parameters args;
     auto ret_vals = returning_vals(returning);
-    return exec(
-            coerce<utf8_string>(
-                    string("INSERT INTO ") + relation + " (" + columns(values)
-                    + ") VALUES (" + value_string(*pimpl->trans, values)
+    auto results = exec_cached(
+            string("INSERT INTO ") + relation + " (" + columns(values)
+                    + ") VALUES (" + value_string(args, values)
                     + ") "
                       "RETURNING "
-                    + ret_vals));
+                    + ret_vals,
+            args);
+    pimpl->wrote(relation);
+    return results;
 }
 
 
@@ -242,25 +952,24 @@ fostlib::pg::recordset fostlib::pg::connection::update(
         const json &keys,
         const json &values,
         const std::vector<fostlib::string> &returning) {
+    parameters args;
     string sql("UPDATE "), updates, where;
     sql += relation;
     sql += " SET ";
     for (fostlib::json::const_iterator iter(values.begin());
          iter != values.end(); ++iter) {
         if (updates.empty()) {
-            updates = column(iter.key()) + "=" + value(*pimpl->trans, *iter);
+            updates = column(iter.key()) + "=" + value(args, *iter);
         } else {
-            updates += ", " + column(iter.key()) + "="
-                    + value(*pimpl->trans, *iter);
+            updates += ", " + column(iter.key()) + "=" + value(args, *iter);
         }
     }
     for (fostlib::json::const_iterator iter(keys.begin()); iter != keys.end();
          ++iter) {
         if (where.empty()) {
-            where = column(iter.key()) + "=" + value(*pimpl->trans, *iter);
+            where = column(iter.key()) + "=" + value(args, *iter);
         } else {
-            where += " AND " + column(iter.key()) + "="
-                    + value(*pimpl->trans, *iter);
+            where += " AND " + column(iter.key()) + "=" + value(args, *iter);
         }
     }
     sql += updates + " WHERE " + where;
@@ -268,7 +977,9 @@ fostlib::pg::recordset fostlib::pg::connection::update(
         auto ret_vals = returning_vals(returning);
         sql += " RETURNING " + ret_vals;
     }
-    return exec(coerce<utf8_string>(sql));
+    auto results = exec_cached(sql, args);
+    pimpl->wrote(relation);
+    return results;
 }
 
 
@@ -282,11 +993,12 @@ fostlib::pg::recordset fostlib::pg::connection::upsert(
         const json &keys,
         const json &values,
         const std::vector<fostlib::string> &returning) {
+    parameters args;
     string sql("INSERT INTO "), key_names(columns(keys)),
             value_names(columns(key_names, values)), updates;
     sql += relation;
     sql += " (" + value_names + ") VALUES "
-        "(" + value_string(*pimpl->trans, value_string(*pimpl->trans, keys), values) + ") ";
+        "(" + value_string(args, value_string(args, keys), values) + ") ";
     sql += "ON CONFLICT (" + key_names + ") DO ";
     for (fostlib::json::const_iterator iter(values.begin());
          iter != values.end(); ++iter) {
@@ -306,7 +1018,61 @@ fostlib::pg::recordset fostlib::pg::connection::upsert(
         auto ret_vals = returning_vals(returning);
         sql += " RETURNING " + ret_vals;
     }
-    return exec(coerce<utf8_string>(sql));
+    auto results = exec_cached(sql, args);
+    pimpl->wrote(relation);
+    return results;
+}
+
+
+fostlib::pg::connection &fostlib::pg::connection::insert(
+        const char *relation, const std::vector<json> &rows) {
+    insert(relation, rows, {});
+    return *this;
+}
+fostlib::pg::recordset fostlib::pg::connection::insert(
+        const char *relation,
+        const std::vector<json> &rows,
+        const std::vector<fostlib::string> &returning) {
+    return recordset(
+            std::make_unique<recordset::impl>(pimpl->exec_batches(
+                    relation, rows, [&returning](const json &) {
+                        return returning_clause(returning);
+                    })));
+}
+
+
+fostlib::pg::connection &fostlib::pg::connection::upsert(
+        const char *relation,
+        const std::vector<fostlib::string> &keys,
+        const std::vector<json> &rows) {
+    upsert(relation, keys, rows, {});
+    return *this;
+}
+fostlib::pg::recordset fostlib::pg::connection::upsert(
+        const char *relation,
+        const std::vector<fostlib::string> &keys,
+        const std::vector<json> &rows,
+        const std::vector<fostlib::string> &returning) {
+    const auto key_names = returning_vals(keys);
+    return recordset(std::make_unique<recordset::impl>(pimpl->exec_batches(
+            relation, rows, [&](const json &row) {
+                string sql = " ON CONFLICT (" + key_names + ") DO ", updates;
+                for (fostlib::json::const_iterator iter(row.begin());
+                     iter != row.end(); ++iter) {
+                    const auto name = column(iter.key());
+                    if (std::find(keys.begin(), keys.end(), name)
+                        == keys.end()) {
+                        if (not updates.empty()) { updates += ", "; }
+                        updates += name + " = EXCLUDED." + name;
+                    }
+                }
+                if (updates.empty()) {
+                    sql += "NOTHING";
+                } else {
+                    sql += "UPDATE SET " + updates;
+                }
+                return sql + returning_clause(returning);
+            })));
 }
 
 
@@ -314,6 +1080,7 @@ fostlib::pg::unbound_procedure
         fostlib::pg::connection::procedure(const fostlib::utf8_string &cmd) {
     static std::atomic<unsigned int> number;
     std::string name = "sp_anon_" + std::to_string(++number);
-    pimpl->pqcnx.prepare(name, static_cast<std::string>(cmd));
+    pimpl->prepare(name, static_cast<std::string>(cmd));
+    pimpl->procedures[name] = static_cast<std::string>(cmd);
     return unbound_procedure(*this, name);
 }
@@ -10,24 +10,263 @@
 
 
 #include <fost/pg/connection.hpp>
+#include "cache.hpp"
+#include "metrics.hpp"
 #include <pqxx/connection>
+#include <pqxx/nontransaction>
+#include <pqxx/pipeline>
+#include <pqxx/prepared_statement>
 #include <pqxx/transaction>
 
+#include <chrono>
+#include <functional>
+#include <list>
+#include <set>
+#include <unordered_map>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// Turn the JSON configuration into a libpq DSN together with the
+        /// effective configuration that it represents
+        std::pair<utf8_string, json> dsn_from_json(const json &conf);
+
+        /// The textual form used when sending a JSON value to the server.
+        /// Objects and arrays are sent as JSON, nulls as SQL NULL.
+        std::optional<std::string> parameter(const json &val);
+        /// The value quoted as an SQL literal, for when it can't be sent
+        /// as a parameter
+        string literal(pqxx::transaction_base &, const json &val);
+        /// SQL to run a prepared statement with the arguments given as
+        /// literals
+        std::string execute_sql(
+                pqxx::transaction_base &,
+                const std::string &name,
+                const std::vector<json> &args);
+
+        /// Generate the SQL for `connection::select`, with `bind` giving
+        /// the SQL for each of the values. `what` is the select list.
+        template<typename B>
+        string select_sql(
+                const string &what,
+                const char *relation,
+                const json &values,
+                const json &order,
+                B bind) {
+            string select = "SELECT " + what + " FROM ", where, orderby;
+            select += relation;
+            for (json::const_iterator iter(values.begin());
+                 iter != values.end(); ++iter) {
+                const auto test = coerce<string>(iter.key()) + " = "
+                        + bind(*iter);
+                if (where.empty()) {
+                    where = test;
+                } else {
+                    where += " AND " + test;
+                }
+            }
+            if (not where.empty()) { select += " WHERE " + where; }
+            for (const auto &ob : order) {
+                if (orderby.empty()) {
+                    orderby = " ORDER BY " + coerce<string>(ob);
+                } else {
+                    orderby += ", " + coerce<string>(ob);
+                }
+            }
+            return select + orderby;
+        }
+        template<typename B>
+        string select_sql(
+                const char *relation,
+                const json &values,
+                const json &order,
+                B bind) {
+            return select_sql("*", relation, values, order, bind);
+        }
+
+
+    }
+
+
+}
+
 
 struct fostlib::pg::connection::impl {
     pqxx::connection pqcnx;
-    using transaction_type = pqxx::transaction<pqxx::serializable>;
-    std::unique_ptr<transaction_type> trans;
+
+    /// The kind of transaction the commands are run in, from the
+    /// `transaction` part of the configuration
+    enum class isolation {
+        none,
+        read_committed,
+        repeatable_read,
+        serializable
+    } level = isolation::serializable;
+    bool read_only = false, deferrable = false;
+    /// Start a new transaction of the configured kind
+    std::unique_ptr<pqxx::transaction_base> begin();
+
+    std::unique_ptr<pqxx::transaction_base> trans;
+    /// Incremented each time the transaction is committed or rolled back
+    std::size_t transaction_number = 0;
 
     json configuration;
 
-    impl(const fostlib::utf8_string &dsn)
-    : pqcnx(static_cast<std::string>(dsn)),
-      trans(new transaction_type(pqcnx)),
-      configuration(dsn) {}
+    /// Commands sent by `exec_async` whose results haven't all been read
+    std::unique_ptr<pqxx::pipeline> in_flight;
+    std::size_t in_flight_count = 0;
+    /// Send the SQL without waiting for its results
+    pqxx::pipeline::query_id send(const std::string &sql);
+    /// Wait for the results of a command sent earlier
+    pqxx::result receive(pqxx::pipeline::query_id);
+    /// Read and throw away the results of every command still in flight
+    /// so that the transaction can be ended. The `pending` objects for
+    /// them can tell by the transaction number
+    void abandon_in_flight() noexcept;
+
+    /// Prepared statements for generated SQL keyed by the SQL text, with
+    /// the most recently used at the front
+    std::size_t statement_capacity;
+    std::list<std::pair<std::string, std::string>> statements;
+    std::unordered_map<std::string, decltype(statements)::iterator>
+            statement_index;
+    int64_t statement_hits = 0, statement_misses = 0,
+            statement_evictions = 0;
+    /// The SQL for the procedures prepared by `connection::procedure`
+    std::unordered_map<std::string, std::string> procedures;
+    /// The SQL types of columns, keyed by "relation.column"
+    std::unordered_map<std::string, std::string> column_types;
+    /// The type of the relation's column, looked up in the catalogue the
+    /// first time it is needed
+    const std::string &
+            column_type(const std::string &relation, const std::string &column);
+
+    /// The result cache, if the configuration asks for one
+    std::shared_ptr<result_cache> cache;
+    /// The relations written to in the current transaction. Their results
+    /// aren't cached as they may not have been committed, and they are
+    /// invalidated again on commit in case another connection cached them
+    /// in the meantime.
+    std::set<std::string> written;
+    /// Note a write to the relation
+    void wrote(const char *relation);
+    /// The cache ticket taken when the transaction started. Everything
+    /// read in the transaction may come from a snapshot as old as that,
+    /// so results are only stored if nothing was invalidated since.
+    result_cache::ticket transaction_ticket = 0;
+    /// The ticket to store results read by a command about to run
+    result_cache::ticket cache_ticket() const;
+
+    /// Figures for the commands run on this connection. These are also
+    /// added to the figures for the process. Only kept when the "Query
+    /// metrics" setting is on.
+    query_metrics metrics;
+    const bool recording;
+    /// Commands taking at least this many seconds are logged. Zero turns
+    /// the logging off.
+    const double slow_query;
+    /// True if commands need timing, for either the metrics or the slow
+    /// query log
+    const bool measuring = recording || slow_query > 0;
+    /// Seconds spent preparing the statement for the current command
+    double preparing = 0;
+    /// Record the figures for a command, logging it if it was slow
+    void executed(
+            const std::string &sql, double seconds, const pqxx::result &);
+    /// Run the command and record its figures
+    template<typename F>
+    pqxx::result measured(const std::string &sql, F f) {
+        if (not measuring) { return f(); }
+        const auto started = std::chrono::steady_clock::now();
+        auto result = f();
+        executed(
+                sql,
+                std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - started)
+                        .count(),
+                result);
+        return result;
+    }
+    /// Prepare the statement, recording and returning how many seconds
+    /// it took
+    double prepare(const std::string &name, const std::string &sql);
 
-    impl(const std::pair<fostlib::utf8_string, fostlib::json> &dsn)
-    : pqcnx(static_cast<std::string>(dsn.first)),
-      trans(new transaction_type(pqcnx)),
-      configuration(dsn.second) {}
+    /// Objects that refer back to the connection, like streaming
+    /// recordsets, watch this so they can tell when it has been destroyed
+    const std::shared_ptr<const bool> lifetime = std::make_shared<bool>(true);
+
+    impl(const fostlib::utf8_string &dsn);
+    impl(const std::pair<fostlib::utf8_string, fostlib::json> &dsn);
+
+    /// Execute a prepared statement, binding the arguments by passing them
+    /// through `transform`
+    template<typename Coll, typename Func>
+    pqxx::result
+            exec_prepared(const std::string &name, Coll &args, Func transform) {
+        return trans->exec_prepared(
+                name, pqxx::prepare::make_dynamic_params(args, transform));
+    }
+
+    /// Execute the SQL with the arguments, preparing it first if it isn't
+    /// already in the statement cache
+    pqxx::result exec_cached(
+            const std::string &sql,
+            const std::vector<std::optional<std::string>> &args);
+    /// Execute the SQL with the arguments without preparing it
+    pqxx::result exec_params(
+            const std::string &sql,
+            const std::vector<std::optional<std::string>> &args);
+
+    /// True if the query's results decode to the same JSON from the binary
+    /// format as from the text format. This is worked out from the result
+    /// description of a cursor for the query, without fetching any rows,
+    /// so the query is never run.
+    bool binary_like_text(const std::string &query);
+
+    /// Insert the rows using multi-row INSERT statements, with `clauses`
+    /// giving the SQL to follow the VALUES list. There is one result per
+    /// statement executed.
+    std::vector<pqxx::result> exec_batches(
+            const char *relation,
+            const std::vector<json> &rows,
+            std::function<string(const json &)> clauses);
 };
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// A reference to a connection that may be destroyed first. Using
+        /// it after that throws rather than touching freed memory.
+        class connection_reference {
+            connection::impl *cnx;
+            std::weak_ptr<const bool> lifetime;
+
+          public:
+            connection_reference(connection::impl &c)
+            : cnx(&c), lifetime(c.lifetime) {}
+
+            bool alive() const { return not lifetime.expired(); }
+
+            connection::impl &operator*() const {
+                if (not alive()) {
+                    throw exceptions::null(
+                            "The database connection has been destroyed");
+                }
+                return *cnx;
+            }
+            connection::impl *operator->() const { return &**this; }
+        };
+
+
+    }
+
+
+}
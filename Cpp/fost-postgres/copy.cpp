@@ -0,0 +1,397 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/connection.hpp>
+#include <fost/pg/copy.hpp>
+#include "connection.hpp"
+
+#include <fost/exception/out_of_range.hpp>
+#include <fost/log>
+#include <pqxx/stream_from>
+#include <pqxx/stream_to>
+
+#include <cctype>
+#include <cerrno>
+#include <exception>
+#include <ostream>
+#include <system_error>
+#include <unistd.h>
+
+
+struct fostlib::pg::copy_writer::impl {
+    connection_reference cnx;
+    const std::string relation;
+    const std::vector<fostlib::string> columns;
+    const std::size_t flush_bytes;
+    /// The exceptions already in flight when the writer was made, so the
+    /// destructor can tell if it is being run because of a new one
+    const int exceptions = std::uncaught_exceptions();
+    std::unique_ptr<pqxx::stream_to> stream;
+    /// Encoded rows waiting to be sent. The buffer keeps its capacity
+    /// between flushes.
+    std::string buffer;
+    /// Where the row being written starts in the buffer
+    std::size_t row_start = 0;
+    std::size_t fields = 0, rows = 0;
+    bool completed = false;
+
+    impl(connection::impl &c,
+         const char *r,
+         std::vector<fostlib::string> cols,
+         std::size_t fb)
+    : cnx(c),
+      relation(r),
+      columns(std::move(cols)),
+      flush_bytes(fb),
+      stream(std::make_unique<pqxx::stream_to>(
+              *c.trans, relation, names(columns))) {
+        buffer.reserve(flush_bytes + flush_bytes / 4);
+    }
+
+    static std::vector<std::string>
+            names(const std::vector<fostlib::string> &cols) {
+        std::vector<std::string> n;
+        n.reserve(cols.size());
+        for (const auto &c : cols) { n.push_back(static_cast<std::string>(c)); }
+        return n;
+    }
+
+    void separator() {
+        if (fields++) { buffer += '\t'; }
+    }
+
+    /// Append a value escaped for the COPY text format
+    void escaped(std::string_view v) {
+        separator();
+        for (const char c : v) {
+            switch (c) {
+            case '\\': buffer += "\\\\"; break;
+            case '\t': buffer += "\\t"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            default: buffer += c;
+            }
+        }
+    }
+
+    void flush() {
+        if (not buffer.empty()) {
+            /// Throws if the connection, and so the stream's transaction,
+            /// has gone
+            *cnx;
+            /// `write_raw_line` adds the final row's line terminator
+            stream->write_raw_line(
+                    std::string_view{buffer.data(), buffer.size() - 1});
+            buffer.clear();
+            row_start = 0;
+        }
+    }
+
+    /// End the COPY without writing any of its rows. libpqxx can't cancel
+    /// a COPY, so a line with one field too many is sent, which the server
+    /// rejects, failing the whole COPY.
+    void abandon() noexcept {
+        completed = true;
+        buffer.clear();
+        try {
+            stream->write_raw_line(std::string(columns.size(), '\t'));
+            stream->complete();
+        } catch (std::exception &) {
+            /// The server is expected to reject the COPY
+        }
+    }
+};
+
+
+fostlib::pg::copy_writer::copy_writer(
+        connection &cnx,
+        const char *relation,
+        std::vector<fostlib::string> columns,
+        std::size_t flush_bytes)
+: pimpl(std::make_unique<impl>(
+        *cnx.pimpl, relation, std::move(columns), flush_bytes)) {}
+
+
+fostlib::pg::copy_writer::copy_writer(copy_writer &&w)
+: pimpl(std::move(w.pimpl)) {}
+
+
+fostlib::pg::copy_writer::~copy_writer() {
+    if (not pimpl || pimpl->completed) {
+        return;
+    } else if (not pimpl->cnx.alive()) {
+        /// The open stream refers to the destroyed connection's
+        /// transaction, so even destroying it would use freed memory
+        pimpl->stream.release();
+        fostlib::log::error(c_fost_pg)(
+                "", "COPY abandoned after its connection was destroyed")(
+                "relation", pimpl->relation.c_str());
+    } else if (std::uncaught_exceptions() > pimpl->exceptions) {
+        /// An error is being thrown, so the rows must not be written
+        pimpl->abandon();
+    } else {
+        try {
+            complete();
+        } catch (std::exception &e) {
+            fostlib::log::error(c_fost_pg)("", "Error completing COPY")(
+                    "exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+        }
+    }
+}
+
+
+void fostlib::pg::copy_writer::field(std::nullopt_t) {
+    pimpl->separator();
+    pimpl->buffer += "\\N";
+}
+void fostlib::pg::copy_writer::field(const json &v) {
+    if (auto p = parameter(v); p) {
+        pimpl->escaped(*p);
+    } else {
+        field(std::nullopt);
+    }
+}
+void fostlib::pg::copy_writer::field(bool b) {
+    pimpl->separator();
+    pimpl->buffer += b ? 't' : 'f';
+}
+void fostlib::pg::copy_writer::field(int64_t i) {
+    pimpl->separator();
+    pimpl->buffer += std::to_string(i);
+}
+void fostlib::pg::copy_writer::field(double d) { field(json(d)); }
+void fostlib::pg::copy_writer::field(std::string_view s) {
+    pimpl->escaped(s);
+}
+
+
+void fostlib::pg::copy_writer::end_row() {
+    if (pimpl->fields != pimpl->columns.size()) {
+        /// Drop the partial row so that it is never sent
+        const auto fields = pimpl->fields;
+        pimpl->buffer.resize(pimpl->row_start);
+        pimpl->fields = 0;
+        throw fostlib::exceptions::out_of_range<std::size_t>(
+                "The COPY row must have one value for each column",
+                pimpl->columns.size(), pimpl->columns.size(), fields);
+    }
+    pimpl->buffer += '\n';
+    pimpl->row_start = pimpl->buffer.size();
+    pimpl->fields = 0;
+    ++pimpl->rows;
+    if (pimpl->buffer.size() >= pimpl->flush_bytes) { pimpl->flush(); }
+}
+
+
+fostlib::pg::copy_writer &fostlib::pg::copy_writer::row(const json &r) {
+    if (r.isobject()) {
+        for (const auto &c : pimpl->columns) {
+            if (r.has_key(c)) {
+                field(r[c]);
+            } else {
+                field(std::nullopt);
+            }
+        }
+    } else {
+        for (const auto &v : r) { field(v); }
+    }
+    end_row();
+    return *this;
+}
+
+
+fostlib::pg::copy_writer &fostlib::pg::copy_writer::flush() {
+    pimpl->flush();
+    return *this;
+}
+
+
+std::size_t fostlib::pg::copy_writer::complete() {
+    pimpl->flush();
+    auto &cnx = *pimpl->cnx;
+    pimpl->completed = true;
+    pimpl->stream->complete();
+    cnx.wrote(pimpl->relation.c_str());
+    return pimpl->rows;
+}
+
+
+fostlib::pg::copy_writer fostlib::pg::connection::copy_in(
+        const char *relation,
+        std::vector<fostlib::string> columns,
+        std::size_t flush_bytes) {
+    return copy_writer(*this, relation, std::move(columns), flush_bytes);
+}
+
+
+/**
+    ## COPY TO STDOUT
+*/
+
+
+namespace {
+
+
+    /// Undo the COPY text format escaping of a field
+    void unescape(std::string_view field, std::string &value) {
+        if (field.find('\\') == std::string_view::npos) {
+            value.assign(field);
+            return;
+        }
+        value.clear();
+        for (std::size_t pos{}; pos != field.size(); ++pos) {
+            if (field[pos] != '\\' || pos + 1 == field.size()) {
+                value += field[pos];
+                continue;
+            }
+            const char c = field[++pos];
+            switch (c) {
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'v': value += '\v'; break;
+            case 'x': {
+                int byte{}, digits{};
+                for (; digits != 2 && pos + 1 < field.size()
+                     && std::isxdigit(static_cast<unsigned char>(
+                             field[pos + 1]));
+                     ++digits) {
+                    const char h = field[++pos];
+                    byte = byte * 16
+                            + (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+                }
+                value += digits ? char(byte) : 'x';
+                break;
+            }
+            default:
+                if (c >= '0' && c <= '7') {
+                    int byte = c - '0';
+                    for (int digits{1}; digits != 3 && pos + 1 < field.size()
+                         && field[pos + 1] >= '0' && field[pos + 1] <= '7';
+                         ++digits) {
+                        byte = byte * 8 + (field[++pos] - '0');
+                    }
+                    value += char(byte);
+                } else {
+                    value += c;
+                }
+            }
+        }
+    }
+
+
+    /// Append a line of the COPY text format to the buffer as CSV. This
+    /// matches the server's own CSV output: NULL is an empty field and
+    /// values are quoted only when they need to be.
+    void csv(std::string_view line, std::string &buffer, std::string &value) {
+        std::size_t start{};
+        while (true) {
+            const auto tab = line.find('\t', start);
+            const auto field = line.substr(
+                    start, tab == std::string_view::npos ? tab : tab - start);
+            if (field != "\\N") {
+                unescape(field, value);
+                if (value.empty() || value == "\\."
+                    || value.find_first_of(",\"\r\n") != std::string::npos) {
+                    buffer += '"';
+                    for (const char c : value) {
+                        if (c == '"') { buffer += '"'; }
+                        buffer += c;
+                    }
+                    buffer += '"';
+                } else {
+                    buffer += value;
+                }
+            }
+            if (tab == std::string_view::npos) { break; }
+            buffer += ',';
+            start = tab + 1;
+        }
+        buffer += '\n';
+    }
+
+
+}
+
+
+std::size_t fostlib::pg::connection::copy_out(
+        const utf8_string &query,
+        const std::function<void(std::string_view)> &sink,
+        copy_format format,
+        std::size_t flush_bytes) {
+    try {
+        pqxx::stream_from stream{*pimpl->trans, pqxx::from_query,
+                                 static_cast<std::string>(query)};
+        std::string buffer, value;
+        buffer.reserve(flush_bytes + flush_bytes / 4);
+        std::size_t rows{};
+        /// The lines come without their line terminator
+        for (auto line = stream.get_raw_line(); line.first;
+             line = stream.get_raw_line()) {
+            const std::string_view text{line.first.get(), line.second};
+            if (format == copy_format::csv) {
+                csv(text, buffer, value);
+            } else {
+                buffer += text;
+                buffer += '\n';
+            }
+            ++rows;
+            if (buffer.size() >= flush_bytes) {
+                sink(buffer);
+                buffer.clear();
+            }
+        }
+        stream.complete();
+        if (not buffer.empty()) { sink(buffer); }
+        return rows;
+    } catch (std::exception &e) {
+        fostlib::log::error(c_fost_pg)("", "Error executing COPY TO STDOUT")(
+                "sql", query)("exception", "what", e.what())(
+                "exception", "type", typeid(e).name());
+        throw;
+    }
+}
+
+
+std::size_t fostlib::pg::connection::copy_out(
+        const utf8_string &query, std::ostream &os, copy_format format) {
+    return copy_out(
+            query,
+            [&os](std::string_view chunk) {
+                if (not os.write(chunk.data(), chunk.size())) {
+                    throw std::system_error(
+                            std::make_error_code(std::errc::io_error),
+                            "Writing COPY output to the stream");
+                }
+            },
+            format);
+}
+
+
+std::size_t fostlib::pg::connection::copy_out(
+        const utf8_string &query, int fd, copy_format format) {
+    return copy_out(
+            query,
+            [fd](std::string_view chunk) {
+                while (not chunk.empty()) {
+                    const auto written =
+                            ::write(fd, chunk.data(), chunk.size());
+                    if (written < 0) {
+                        if (errno == EINTR) { continue; }
+                        throw std::system_error(
+                                errno, std::generic_category(),
+                                "Writing COPY output to the file descriptor");
+                    }
+                    chunk.remove_prefix(written);
+                }
+            },
+            format);
+}
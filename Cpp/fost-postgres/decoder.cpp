@@ -0,0 +1,919 @@
+/**
+    Copyright 2015-2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/core>
+#include <fost/exception/parse_error.hpp>
+#include <fost/insert>
+#include <fost/log>
+#include <fost/pg/connection.hpp>
+#include <fost/pg/decoder.hpp>
+
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <locale.h>
+
+
+namespace {
+    template<typename I>
+    I integer(std::string_view s) {
+        I value{};
+        const auto end = s.data() + s.size();
+        const auto [ptr, ec] = std::from_chars(s.data(), end, value);
+        if (ec == std::errc::result_out_of_range) {
+            throw fostlib::exceptions::parse_error(
+                    "Integer is out of range for the requested type",
+                    std::string(s));
+        } else if (ec != std::errc{} || ptr != end) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing an int", std::string(s));
+        }
+        return value;
+    }
+    /// The C locale, so that the C library always uses a `.` for the
+    /// decimal point whatever locale the program has set
+    locale_t c_locale() {
+        static const locale_t c = newlocale(LC_ALL_MASK, "C", locale_t(0));
+        return c;
+    }
+    /// Switches the calling thread to the C locale for its lifetime
+    class c_numbers {
+        const locale_t previous;
+
+      public:
+        c_numbers() : previous(uselocale(c_locale())) {}
+        ~c_numbers() { uselocale(previous); }
+    };
+
+    /// `strtod` in the C locale. It needs the text to be NUL terminated
+    double strtod_c(std::string_view s) {
+        char buffer[64];
+        std::string copy;
+        const char *text = buffer;
+        if (s.size() < sizeof(buffer)) {
+            std::memcpy(buffer, s.data(), s.size());
+            buffer[s.size()] = '\0';
+        } else {
+            copy = s;
+            text = copy.c_str();
+        }
+        char *end = nullptr;
+        const double value = strtod_l(text, &end, c_locale());
+        if (end != text + s.size()) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing a double", std::string(s));
+        }
+        return value;
+    }
+
+    /// `from_chars` for `double` needs GCC 11, so older compilers use
+    /// `strtod_l`. Both ignore the program's locale.
+    double floating(std::string_view s) {
+        if (s.empty() || std::isspace(static_cast<unsigned char>(s[0]))) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing a double", std::string(s));
+        }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        double value{};
+        const auto end = s.data() + s.size();
+        const auto [ptr, ec] = std::from_chars(s.data(), end, value);
+        if (ec == std::errc{} && ptr == end) {
+            return value;
+        } else if (ec != std::errc::result_out_of_range) {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing a double", std::string(s));
+        }
+        /// `strtod` gives the closest value for those out of range
+#endif
+        return strtod_c(s);
+    }
+}
+
+
+/**
+    ## Numeric types
+*/
+
+
+bool fostlib::pg::decoder<bool>::accepts(unsigned int oid) {
+    return oid == 16;
+}
+bool fostlib::pg::decoder<bool>::decode(unsigned int, std::string_view s) {
+    return not s.empty() && s[0] == 't';
+}
+
+
+bool fostlib::pg::decoder<int16_t>::accepts(unsigned int oid) {
+    return oid == 21;
+}
+int16_t fostlib::pg::decoder<int16_t>::decode(
+        unsigned int, std::string_view s) {
+    return integer<int16_t>(s);
+}
+
+
+bool fostlib::pg::decoder<int32_t>::accepts(unsigned int oid) {
+    return oid == 21 || oid == 23;
+}
+int32_t fostlib::pg::decoder<int32_t>::decode(
+        unsigned int, std::string_view s) {
+    return integer<int32_t>(s);
+}
+
+
+bool fostlib::pg::decoder<int64_t>::accepts(unsigned int oid) {
+    return oid == 21 || oid == 23 || oid == 20 || oid == 26;
+}
+int64_t fostlib::pg::decoder<int64_t>::decode(
+        unsigned int, std::string_view s) {
+    return integer<int64_t>(s);
+}
+
+
+bool fostlib::pg::decoder<double>::accepts(unsigned int oid) {
+    return oid == 700 || oid == 701 || decoder<int64_t>::accepts(oid);
+}
+double fostlib::pg::decoder<double>::decode(
+        unsigned int, std::string_view s) {
+    return floating(s);
+}
+
+
+/**
+    ## bytea
+*/
+
+
+namespace {
+    [[noreturn]] void bad_bytea(std::string_view s) {
+        throw fostlib::exceptions::parse_error(
+                "Whilst decoding a bytea field", std::string(s.substr(0, 64)));
+    }
+    bool octal(char c) { return c >= '0' && c <= '7'; }
+    int hex_digit(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+}
+
+
+void fostlib::pg::bytea_from_text(
+        std::string_view s, std::vector<unsigned char> &bytes) {
+    if (s.size() >= 2 && s[0] == '\\' && s[1] == 'x') {
+        if (s.size() % 2) { bad_bytea(s); }
+        bytes.reserve(bytes.size() + (s.size() - 2) / 2);
+        for (std::size_t pos{2}; pos != s.size(); pos += 2) {
+            const int high = hex_digit(s[pos]), low = hex_digit(s[pos + 1]);
+            if (high < 0 || low < 0) { bad_bytea(s); }
+            bytes.push_back((high << 4) | low);
+        }
+    } else {
+        /// The escape format, where backslashes are doubled and other
+        /// bytes may be given as three octal digits
+        for (std::size_t pos{}; pos != s.size(); ++pos) {
+            if (s[pos] != '\\') {
+                bytes.push_back(s[pos]);
+            } else if (pos + 1 < s.size() && s[pos + 1] == '\\') {
+                bytes.push_back('\\');
+                ++pos;
+            } else if (
+                    pos + 3 < s.size() && octal(s[pos + 1])
+                    && octal(s[pos + 2]) && octal(s[pos + 3])) {
+                bytes.push_back(
+                        ((s[pos + 1] - '0') << 6) | ((s[pos + 2] - '0') << 3)
+                        | (s[pos + 3] - '0'));
+                pos += 3;
+            } else {
+                bad_bytea(s);
+            }
+        }
+    }
+}
+
+
+std::vector<unsigned char>
+        fostlib::pg::decoder<std::vector<unsigned char>>::decode(
+                unsigned int, std::string_view s) {
+    std::vector<unsigned char> bytes;
+    bytea_from_text(s, bytes);
+    return bytes;
+}
+
+
+/**
+    ## Calendar
+*/
+
+
+namespace {
+    /// Days since 1970-01-01 for the proleptic Gregorian date
+    constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+
+    /// The proleptic Gregorian date for the days since 1970-01-01
+    constexpr std::tuple<int64_t, unsigned, unsigned>
+            civil_from_days(int64_t z) {
+        z += 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(z - era * 146097);
+        const unsigned yoe =
+                (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+        const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+        return {static_cast<int64_t>(yoe) + era * 400 + (m <= 2), m, d};
+    }
+}
+
+
+/**
+    ## JSON
+*/
+
+
+namespace {
+    /// Builds the JSON for `json` and `jsonb` fields directly from the
+    /// text in a single pass. Strings without escapes are copied straight
+    /// out of the field.
+    class json_parser {
+        std::string_view text;
+        std::size_t pos = 0;
+
+        [[noreturn]] void error() const {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing JSON", std::string(text));
+        }
+
+        void whitespace() {
+            while (pos < text.size()
+                   && (text[pos] == ' ' || text[pos] == '\t'
+                       || text[pos] == '\n' || text[pos] == '\r')) {
+                ++pos;
+            }
+        }
+        bool next(char c) {
+            whitespace();
+            if (pos < text.size() && text[pos] == c) {
+                ++pos;
+                return true;
+            } else {
+                return false;
+            }
+        }
+        void expect(char c) {
+            if (not next(c)) { error(); }
+        }
+        fostlib::json literal(std::string_view word, fostlib::json v) {
+            if (text.substr(pos, word.size()) != word) { error(); }
+            pos += word.size();
+            return v;
+        }
+
+        unsigned int hex4() {
+            if (pos + 4 > text.size()) { error(); }
+            unsigned int value{};
+            const auto [ptr, ec] = std::from_chars(
+                    text.data() + pos, text.data() + pos + 4, value, 16);
+            if (ec != std::errc{} || ptr != text.data() + pos + 4) {
+                error();
+            }
+            pos += 4;
+            return value;
+        }
+        void utf8(std::string &s, unsigned int cp) {
+            if (cp < 0x80) {
+                s += char(cp);
+            } else if (cp < 0x800) {
+                s += char(0xc0 | (cp >> 6));
+                s += char(0x80 | (cp & 0x3f));
+            } else if (cp < 0x10000) {
+                s += char(0xe0 | (cp >> 12));
+                s += char(0x80 | ((cp >> 6) & 0x3f));
+                s += char(0x80 | (cp & 0x3f));
+            } else {
+                s += char(0xf0 | (cp >> 18));
+                s += char(0x80 | ((cp >> 12) & 0x3f));
+                s += char(0x80 | ((cp >> 6) & 0x3f));
+                s += char(0x80 | (cp & 0x3f));
+            }
+        }
+        fostlib::string string() {
+            const auto start = ++pos;
+            while (pos < text.size() && text[pos] != '"' && text[pos] != '\\') {
+                ++pos;
+            }
+            if (pos == text.size()) { error(); }
+            std::string s{text.substr(start, pos - start)};
+            while (text[pos] != '"') {
+                if (text[pos] == '\\') {
+                    if (++pos == text.size()) { error(); }
+                    switch (text[pos++]) {
+                    case '"': s += '"'; break;
+                    case '\\': s += '\\'; break;
+                    case '/': s += '/'; break;
+                    case 'b': s += '\b'; break;
+                    case 'f': s += '\f'; break;
+                    case 'n': s += '\n'; break;
+                    case 'r': s += '\r'; break;
+                    case 't': s += '\t'; break;
+                    case 'u': {
+                        auto cp = hex4();
+                        if (cp >= 0xd800 && cp < 0xdc00
+                            && text.substr(pos, 2) == "\\u") {
+                            pos += 2;
+                            const auto low = hex4();
+                            if (low < 0xdc00 || low >= 0xe000) { error(); }
+                            cp = 0x10000 + ((cp - 0xd800) << 10)
+                                    + (low - 0xdc00);
+                        }
+                        utf8(s, cp);
+                        break;
+                    }
+                    default: error();
+                    }
+                } else {
+                    s += text[pos++];
+                }
+                if (pos == text.size()) { error(); }
+            }
+            ++pos;
+            return fostlib::string(std::move(s));
+        }
+        fostlib::json number() {
+            const auto start = pos;
+            bool integral = true;
+            while (pos < text.size()) {
+                const char c = text[pos];
+                if (c == '.' || c == 'e' || c == 'E') {
+                    integral = false;
+                } else if ((c < '0' || c > '9') && c != '-' && c != '+') {
+                    break;
+                }
+                ++pos;
+            }
+            const auto n = text.substr(start, pos - start);
+            if (n.empty()) { error(); }
+            if (integral) {
+                int64_t value{};
+                const auto [ptr, ec] =
+                        std::from_chars(n.data(), n.data() + n.size(), value);
+                if (ec == std::errc{} && ptr == n.data() + n.size()) {
+                    return fostlib::json(value);
+                }
+            }
+            return fostlib::json(floating(n));
+        }
+        fostlib::json array() {
+            ++pos;
+            fostlib::json a = fostlib::json::array_t();
+            if (next(']')) { return a; }
+            do {
+                fostlib::jcursor().push_back(a, value());
+            } while (next(','));
+            expect(']');
+            return a;
+        }
+        fostlib::json object() {
+            ++pos;
+            fostlib::json o = fostlib::json::object_t();
+            if (next('}')) { return o; }
+            do {
+                whitespace();
+                if (pos == text.size() || text[pos] != '"') { error(); }
+                auto key = string();
+                expect(':');
+                auto v = value();
+                if (o.has_key(key)) {
+                    /// Only `json` can have duplicate keys, and as for
+                    /// `jsonb` the last one wins
+                    fostlib::jcursor(key).replace(o, v);
+                } else {
+                    fostlib::insert(o, key, v);
+                }
+            } while (next(','));
+            expect('}');
+            return o;
+        }
+
+        fostlib::json value() {
+            whitespace();
+            if (pos == text.size()) { error(); }
+            switch (text[pos]) {
+            case '{': return object();
+            case '[': return array();
+            case '"': return fostlib::json(string());
+            case 't': return literal("true", fostlib::json(true));
+            case 'f': return literal("false", fostlib::json(false));
+            case 'n': return literal("null", fostlib::json());
+            default: return number();
+            }
+        }
+
+      public:
+        json_parser(std::string_view t) : text(t) {}
+
+        fostlib::json document() {
+            auto v = value();
+            whitespace();
+            if (pos != text.size()) { error(); }
+            return v;
+        }
+    };
+
+
+    fostlib::json text_bool(unsigned int oid, std::string_view s) {
+        return fostlib::json(fostlib::pg::decoder<bool>::decode(oid, s));
+    }
+    fostlib::json text_integer(unsigned int, std::string_view s) {
+        return fostlib::json(integer<int64_t>(s));
+    }
+    fostlib::json text_float(unsigned int, std::string_view s) {
+        return fostlib::json(floating(s));
+    }
+    fostlib::json text_json(unsigned int, std::string_view s) {
+        return json_parser{s}.document();
+    }
+    fostlib::json text_string(unsigned int, std::string_view s) {
+        return fostlib::json(fostlib::string(std::string(s)));
+    }
+    /// Types without their own decoder are given as their text. This is
+    /// a separate function so that `known` can tell them apart
+    fostlib::json text_unknown(unsigned int, std::string_view s) {
+        return fostlib::json(fostlib::string(std::string(s)));
+    }
+    fostlib::json timestamp_without_zone(unsigned int, std::string_view) {
+        throw fostlib::exceptions::not_implemented(
+                __FUNCTION__,
+                "Timestamp fields without time zones are "
+                "explicitly disabled. "
+                "Fix your schema to use 'timestamp with time "
+                "zone'");
+    }
+}
+
+
+bool fostlib::pg::decoder<fostlib::json>::accepts(unsigned int oid) {
+    return oid != 1114;
+}
+fostlib::json fostlib::pg::decoder<fostlib::json>::decode(
+        unsigned int oid, std::string_view s) {
+    return plan(oid)(oid, s);
+}
+fostlib::pg::decoder<fostlib::json>::function
+        fostlib::pg::decoder<fostlib::json>::plan(unsigned int oid) {
+    switch (oid) {
+    case 16: // bool
+        return text_bool;
+    case 21: // int2
+    case 23: // int4
+    case 20: // int8
+    case 26: // oid
+        return text_integer;
+    case 700: // float4
+    case 701: // float8
+        return text_float;
+    case 114: // json
+    case 3802: // jsonb
+        return text_json;
+    case 1114: // timestamp without time zone
+        return timestamp_without_zone;
+    default: return text_unknown;
+    case 17: // bytea, as its hex encoding
+    case 25: // text
+    case 1043: // varchar
+    case 1082: // date
+    case 1083: // time
+    case 1184: // timestamp with time zone
+    case 1700: // numeric
+    case 2950: // uuid
+        return text_string;
+    }
+}
+bool fostlib::pg::decoder<fostlib::json>::known(unsigned int oid) {
+    return plan(oid) != text_unknown;
+}
+
+
+/**
+    ## Binary format
+*/
+
+
+namespace {
+    [[noreturn]] void bad_binary(unsigned int oid, std::string_view bytes) {
+        throw fostlib::exceptions::parse_error(
+                "Binary value has the wrong size for type OID "
+                        + fostlib::coerce<fostlib::string>(int64_t(oid)),
+                fostlib::coerce<fostlib::string>(int64_t(bytes.size())));
+    }
+
+    /// Read a big endian (network order) integer of the given size
+    template<typename I>
+    I network(const char *data) {
+        std::make_unsigned_t<I> value{};
+        for (std::size_t i{}; i != sizeof(I); ++i) {
+            value = (value << 8) | static_cast<unsigned char>(data[i]);
+        }
+        return static_cast<I>(value);
+    }
+    template<typename I>
+    I network(unsigned int oid, std::string_view bytes) {
+        if (bytes.size() != sizeof(I)) { bad_binary(oid, bytes); }
+        return network<I>(bytes.data());
+    }
+
+    std::string two(int64_t n) {
+        return std::string{char('0' + n / 10), char('0' + n % 10)};
+    }
+    /// The date as the ISO date style, with `BC` years
+    std::string iso_date(int64_t days_since_epoch, std::string &suffix) {
+        auto [year, month, day] = civil_from_days(days_since_epoch);
+        if (year <= 0) {
+            year = 1 - year;
+            suffix = " BC";
+        }
+        auto y = std::to_string(year);
+        if (y.size() < 4) { y.insert(0, 4 - y.size(), '0'); }
+        return y + "-" + two(month) + "-" + two(day);
+    }
+    /// Time of day from microseconds, dropping trailing zeros in the
+    /// fraction in the same way as Postgres
+    std::string iso_time(int64_t micros) {
+        auto t = two(micros / 3600000000) + ":" + two(micros / 60000000 % 60)
+                + ":" + two(micros / 1000000 % 60);
+        if (auto fraction = micros % 1000000; fraction) {
+            auto f = std::to_string(fraction + 1000000).substr(1);
+            f.erase(f.find_last_not_of('0') + 1);
+            t += "." + f;
+        }
+        return t;
+    }
+
+    /// Postgres' binary dates and times count from 2000-01-01
+    constexpr int64_t c_pg_epoch_days = 10957;
+
+    std::string pg_date(int32_t days) {
+        if (days == std::numeric_limits<int32_t>::max()) {
+            return "infinity";
+        } else if (days == std::numeric_limits<int32_t>::min()) {
+            return "-infinity";
+        }
+        std::string suffix;
+        return iso_date(days + c_pg_epoch_days, suffix) + suffix;
+    }
+    std::string pg_timestamptz(int64_t micros) {
+        if (micros == std::numeric_limits<int64_t>::max()) {
+            return "infinity";
+        } else if (micros == std::numeric_limits<int64_t>::min()) {
+            return "-infinity";
+        }
+        constexpr int64_t day = 86400000000;
+        int64_t days = micros / day, time = micros % day;
+        if (time < 0) {
+            time += day;
+            days -= 1;
+        }
+        std::string suffix;
+        auto date = iso_date(days + c_pg_epoch_days, suffix);
+        return date + " " + iso_time(time) + "+00" + suffix;
+    }
+
+    std::string pg_uuid(unsigned int oid, std::string_view bytes) {
+        if (bytes.size() != 16) { bad_binary(oid, bytes); }
+        constexpr char hex[] = "0123456789abcdef";
+        std::string u;
+        u.reserve(36);
+        for (std::size_t i{}; i != 16; ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10) { u += '-'; }
+            const auto b = static_cast<unsigned char>(bytes[i]);
+            u += hex[b >> 4];
+            u += hex[b & 0xf];
+        }
+        return u;
+    }
+
+    /// Numeric values are sent as base 10000 digits together with the
+    /// weight of the first digit and the display scale
+    std::string pg_numeric(unsigned int oid, std::string_view bytes) {
+        if (bytes.size() < 8) { bad_binary(oid, bytes); }
+        const auto ndigits = network<int16_t>(bytes.data());
+        const auto weight = network<int16_t>(bytes.data() + 2);
+        const auto sign = network<uint16_t>(bytes.data() + 4);
+        const auto dscale = network<uint16_t>(bytes.data() + 6);
+        if (bytes.size() != 8u + 2u * ndigits) { bad_binary(oid, bytes); }
+        if (sign == 0xC000) {
+            return "NaN";
+        } else if (sign == 0xD000) {
+            return "Infinity";
+        } else if (sign == 0xF000) {
+            return "-Infinity";
+        }
+        auto digit = [&](int index) -> int {
+            return index >= 0 && index < ndigits
+                    ? network<int16_t>(bytes.data() + 8 + 2 * index)
+                    : 0;
+        };
+        std::string n;
+        if (sign == 0x4000) { n += '-'; }
+        if (weight < 0) {
+            n += '0';
+        } else {
+            for (int index{}; index <= weight; ++index) {
+                auto d = std::to_string(digit(index));
+                if (index) { d.insert(0, 4 - d.size(), '0'); }
+                n += d;
+            }
+        }
+        if (dscale) {
+            std::string fraction;
+            for (int index = weight + 1; fraction.size() < dscale; ++index) {
+                auto d = std::to_string(digit(index));
+                fraction += std::string(4 - d.size(), '0') + d;
+            }
+            n += "." + fraction.substr(0, dscale);
+        }
+        return n;
+    }
+
+    /// Shortest decimal form that reads back as the same float, as used
+    /// by Postgres for `float4` in text format
+    double pg_float4(float f) {
+        c_numbers c;
+        char buffer[32];
+        for (int precision{1}; precision < 10; ++precision) {
+            std::snprintf(buffer, sizeof(buffer), "%.*g", precision, f);
+            if (std::strtof(buffer, nullptr) == f) { break; }
+        }
+        return std::strtod(buffer, nullptr);
+    }
+}
+
+
+namespace {
+    fostlib::json binary_bool(unsigned int oid, std::string_view bytes) {
+        if (bytes.size() != 1) { bad_binary(oid, bytes); }
+        return fostlib::json(bytes[0] != 0);
+    }
+    template<typename I>
+    fostlib::json binary_integer(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(int64_t(network<I>(oid, bytes)));
+    }
+    fostlib::json binary_float4(unsigned int oid, std::string_view bytes) {
+        const auto bits = network<uint32_t>(oid, bytes);
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return fostlib::json(pg_float4(f));
+    }
+    fostlib::json binary_float8(unsigned int oid, std::string_view bytes) {
+        const auto bits = network<uint64_t>(oid, bytes);
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return fostlib::json(d);
+    }
+    /// jsonb has a version byte before the text
+    fostlib::json binary_jsonb(unsigned int oid, std::string_view bytes) {
+        if (bytes.empty() || bytes[0] != 1) { bad_binary(oid, bytes); }
+        return text_json(oid, bytes.substr(1));
+    }
+    fostlib::json binary_date(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(
+                fostlib::string(pg_date(network<int32_t>(oid, bytes))));
+    }
+    fostlib::json binary_time(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(
+                fostlib::string(iso_time(network<int64_t>(oid, bytes))));
+    }
+    fostlib::json binary_timestamptz(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(fostlib::string(
+                pg_timestamptz(network<int64_t>(oid, bytes))));
+    }
+    fostlib::json binary_numeric(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(fostlib::string(pg_numeric(oid, bytes)));
+    }
+    fostlib::json binary_uuid(unsigned int oid, std::string_view bytes) {
+        return fostlib::json(fostlib::string(pg_uuid(oid, bytes)));
+    }
+    /// Gives the same hex encoding as the text format
+    fostlib::json binary_bytea(unsigned int, std::string_view bytes) {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(2 + 2 * bytes.size());
+        hex += "\\x";
+        for (const unsigned char b : bytes) {
+            hex += digits[b >> 4];
+            hex += digits[b & 0xf];
+        }
+        return fostlib::json(fostlib::string(hex));
+    }
+    fostlib::json binary_unknown(unsigned int oid, std::string_view) {
+        throw fostlib::exceptions::not_implemented(
+                __FUNCTION__,
+                "There is no binary decoder for type OID "
+                        + fostlib::coerce<fostlib::string>(int64_t(oid)));
+    }
+}
+
+
+fostlib::json fostlib::pg::decoder<fostlib::json>::decode_binary(
+        unsigned int oid, std::string_view bytes) {
+    return plan_binary(oid)(oid, bytes);
+}
+fostlib::pg::decoder<fostlib::json>::function
+        fostlib::pg::decoder<fostlib::json>::plan_binary(unsigned int oid) {
+    switch (oid) {
+    case 16: // bool
+        return binary_bool;
+    case 21: // int2
+        return binary_integer<int16_t>;
+    case 23: // int4
+        return binary_integer<int32_t>;
+    case 20: // int8
+        return binary_integer<int64_t>;
+    case 26: // oid
+        return binary_integer<uint32_t>;
+    case 17: // bytea
+        return binary_bytea;
+    case 700: // float4
+        return binary_float4;
+    case 701: // float8
+        return binary_float8;
+    case 114: // json is sent as its text
+    case 25: // text
+    case 1043: // varchar
+        return plan(oid);
+    case 3802: // jsonb
+        return binary_jsonb;
+    case 1082: // date
+        return binary_date;
+    case 1083: // time
+        return binary_time;
+    case 1184: // timestamp with time zone, always given in UTC
+        return binary_timestamptz;
+    case 1700: // numeric
+        return binary_numeric;
+    case 2950: // uuid
+        return binary_uuid;
+    case 1114: // timestamp without time zone
+        return timestamp_without_zone;
+    default: return binary_unknown;
+    }
+}
+bool fostlib::pg::decoder<fostlib::json>::accepts_binary(unsigned int oid) {
+    return plan_binary(oid) != binary_unknown;
+}
+
+
+/**
+    ## Time stamps
+*/
+
+
+namespace {
+    /// Parses the ISO date style output for `timestamp with time zone`,
+    /// e.g. `2020-05-21 10:15:30.25+07`, `1900-01-01 00:00:00+06:42:04`
+    /// or `0044-03-15 12:00:00+00 BC`
+    class timestamp_parser {
+        std::string_view text;
+        std::size_t pos = 0;
+
+        [[noreturn]] void error() const {
+            throw fostlib::exceptions::parse_error(
+                    "Whilst parsing a timestamp with time zone",
+                    std::string(text));
+        }
+
+      public:
+        timestamp_parser(std::string_view t) : text(t) {}
+
+        bool at_end() const { return pos == text.size(); }
+        /// The number of digits from the current position
+        std::size_t digits() const {
+            std::size_t end = pos;
+            while (end < text.size() && text[end] >= '0' && text[end] <= '9') {
+                ++end;
+            }
+            return end - pos;
+        }
+        bool next(char c) {
+            if (pos < text.size() && text[pos] == c) {
+                ++pos;
+                return true;
+            } else {
+                return false;
+            }
+        }
+        void expect(char c) {
+            if (not next(c)) { error(); }
+        }
+        int number(std::size_t digits) {
+            const auto start = text.data() + pos;
+            const auto limit =
+                    text.data() + std::min(text.size(), pos + digits);
+            int value{};
+            auto [ptr, ec] = std::from_chars(start, limit, value);
+            if (ec != std::errc{} || std::size_t(ptr - start) != digits) {
+                error();
+            }
+            pos += digits;
+            return value;
+        }
+        /// Returns the fractional seconds as microseconds
+        int64_t fraction() {
+            int64_t micros{}, scale{100000};
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+                micros += (text[pos++] - '0') * scale;
+                scale /= 10;
+            }
+            return micros;
+        }
+        void done() const {
+            if (not at_end()) { error(); }
+        }
+    };
+}
+
+
+bool fostlib::pg::decoder<std::chrono::system_clock::time_point>::accepts(
+        unsigned int oid) {
+    return oid == 1184;
+}
+std::chrono::system_clock::time_point
+        fostlib::pg::decoder<std::chrono::system_clock::time_point>::decode(
+                unsigned int, std::string_view s) {
+    using time_point = std::chrono::system_clock::time_point;
+    if (s == "infinity") {
+        return time_point::max();
+    } else if (s == "-infinity") {
+        return time_point::min();
+    }
+    timestamp_parser p{s};
+    /// Years have at least four digits, and more after 9999
+    int year = p.number(std::max<std::size_t>(p.digits(), 4));
+    p.expect('-');
+    const int month = p.number(2);
+    p.expect('-');
+    const int day = p.number(2);
+    p.expect(' ');
+    const int hour = p.number(2);
+    p.expect(':');
+    const int minute = p.number(2);
+    p.expect(':');
+    const int second = p.number(2);
+    const int64_t micros = p.next('.') ? p.fraction() : 0;
+    int64_t offset{};
+    const bool negative = p.next('-');
+    if (not negative) { p.expect('+'); }
+    offset = p.number(2) * 3600;
+    if (p.next(':')) {
+        offset += p.number(2) * 60;
+        if (p.next(':')) { offset += p.number(2); }
+    }
+    if (p.next(' ')) {
+        p.expect('B');
+        p.expect('C');
+        /// There is no year zero, so 1 BC is year 0 in the proleptic
+        /// Gregorian calendar
+        year = 1 - year;
+    }
+    p.done();
+    if (negative) { offset = -offset; }
+    const int64_t seconds = days_from_civil(year, month, day) * 86400
+            + hour * 3600 + minute * 60 + second - offset;
+    static const int64_t limit =
+            std::chrono::duration_cast<std::chrono::seconds>(
+                    time_point::duration::max())
+                    .count()
+            - 1;
+    if (seconds > limit || seconds < -limit) {
+        throw fostlib::exceptions::parse_error(
+                "The timestamp is outside the range of "
+                "std::chrono::system_clock",
+                std::string(s));
+    }
+    return time_point{
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::microseconds{seconds * 1000000 + micros})};
+}
@@ -0,0 +1,135 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/listener.hpp>
+#include "connection.hpp"
+
+#include <fost/log>
+#include <pqxx/notification>
+
+#include <map>
+
+
+namespace {
+
+
+    /// libpqxx issues the `LISTEN` when the receiver is created and the
+    /// `UNLISTEN` when it is destroyed
+    class receiver final : public pqxx::notification_receiver {
+      public:
+        std::vector<fostlib::pg::listener::callback> callbacks;
+        /// Cleared by `unlisten`, which may happen part way through
+        /// delivering a notification
+        bool listening = true;
+
+        receiver(pqxx::connection &cnx, const std::string &channel)
+        : notification_receiver(cnx, channel) {}
+
+        void operator()(const std::string &payload, int backend_pid) override {
+            const fostlib::pg::listener::notification n{
+                    fostlib::string(channel()), fostlib::string(payload),
+                    backend_pid};
+            /// The callbacks may call `listen` or `unlisten`, so they are
+            /// called from a copy. A failing callback mustn't stop the
+            /// others from hearing about the notification
+            const auto handlers = callbacks;
+            for (const auto &cb : handlers) {
+                if (not listening) { break; }
+                try {
+                    cb(n);
+                } catch (std::exception &e) {
+                    fostlib::log::error(fostlib::pg::c_fost_pg)(
+                            "", "Error handling notification")(
+                            "channel", channel().c_str())(
+                            "payload", payload.c_str())(
+                            "exception", "what", e.what())(
+                            "exception", "type", typeid(e).name());
+                }
+            }
+        }
+    };
+
+
+}
+
+
+struct fostlib::pg::listener::impl {
+    pqxx::connection pqcnx;
+    /// Destroyed before the connection they are registered with
+    std::map<string, std::unique_ptr<receiver>> channels;
+    /// libpqxx is iterating over the receivers whilst notifications are
+    /// dispatched, so those removed by a callback are kept until it is done
+    std::vector<std::unique_ptr<receiver>> retired;
+    std::size_t dispatching = 0;
+
+    impl(const std::string &dsn) : pqcnx(dsn) {}
+
+    template<typename F>
+    std::size_t dispatch(F read) {
+        struct guard {
+            impl &self;
+            guard(impl &s) : self(s) { ++self.dispatching; }
+            ~guard() {
+                if (--self.dispatching == 0) { self.retired.clear(); }
+            }
+        } g{*this};
+        return read();
+    }
+};
+
+
+fostlib::pg::listener::listener() : pimpl(std::make_unique<impl>("")) {}
+fostlib::pg::listener::listener(const json &conf)
+: pimpl(std::make_unique<impl>(
+        static_cast<std::string>(dsn_from_json(conf).first))) {}
+fostlib::pg::listener::listener(listener &&l) : pimpl(std::move(l.pimpl)) {}
+fostlib::pg::listener::~listener() = default;
+
+
+fostlib::pg::listener &
+        fostlib::pg::listener::listen(const string &channel, callback cb) {
+    auto &r = pimpl->channels[channel];
+    if (not r) {
+        r = std::make_unique<receiver>(
+                pimpl->pqcnx, static_cast<std::string>(channel));
+    }
+    r->callbacks.push_back(std::move(cb));
+    return *this;
+}
+
+
+fostlib::pg::listener &fostlib::pg::listener::unlisten(const string &channel) {
+    if (auto found = pimpl->channels.find(channel);
+        found != pimpl->channels.end()) {
+        found->second->listening = false;
+        if (pimpl->dispatching) {
+            pimpl->retired.push_back(std::move(found->second));
+        }
+        pimpl->channels.erase(found);
+    }
+    return *this;
+}
+
+
+int fostlib::pg::listener::socket() const { return pimpl->pqcnx.sock(); }
+
+
+std::size_t fostlib::pg::listener::dispatch() {
+    return pimpl->dispatch([this]() { return pimpl->pqcnx.get_notifs(); });
+}
+
+
+std::size_t fostlib::pg::listener::wait(std::chrono::milliseconds timeout) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::max(timeout, std::chrono::milliseconds{}))
+                            .count();
+    return pimpl->dispatch([this, us]() {
+        return pimpl->pqcnx.await_notification(
+                us / 1'000'000, us % 1'000'000);
+    });
+}
@@ -0,0 +1,146 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include "metrics.hpp"
+
+#include <fost/insert>
+
+
+namespace {
+
+
+    const fostlib::setting<bool> c_query_metrics(
+            "fost-postgres/metrics.cpp",
+            "Postgres",
+            "Query metrics",
+            false,
+            true);
+    const fostlib::setting<int64_t> c_metric_statements(
+            "fost-postgres/metrics.cpp",
+            "Postgres",
+            "Query metrics statements",
+            200,
+            true);
+    /// Zero turns the slow query log off
+    const fostlib::setting<double> c_slow_query(
+            "fost-postgres/metrics.cpp",
+            "Postgres",
+            "Slow query seconds",
+            0.0,
+            true);
+    const fostlib::setting<bool> c_time_decoding(
+            "fost-postgres/metrics.cpp",
+            "Postgres",
+            "Time field decoding",
+            false,
+            true);
+
+
+}
+
+
+/**
+    ## fostlib::pg::command_figures
+*/
+
+
+void fostlib::pg::command_figures::add(double s, int64_t r, int64_t b) {
+    std::size_t bucket{};
+    while (bucket != bounds.size() && s > bounds[bucket]) { ++bucket; }
+    ++histogram[bucket];
+    ++count;
+    rows += r;
+    bytes += b;
+    seconds += s;
+    slowest = std::max(slowest, s);
+}
+
+
+fostlib::json fostlib::pg::command_figures::as_json() const {
+    json figures;
+    insert(figures, "count", count);
+    insert(figures, "rows", rows);
+    insert(figures, "bytes", bytes);
+    insert(figures, "seconds", "total", seconds);
+    insert(figures, "seconds", "mean", count ? seconds / count : 0.0);
+    insert(figures, "seconds", "max", slowest);
+    json buckets;
+    for (const auto n : histogram) { jcursor().push_back(buckets, n); }
+    insert(figures, "histogram", buckets);
+    return figures;
+}
+
+
+/**
+    ## fostlib::pg::query_metrics
+*/
+
+
+void fostlib::pg::query_metrics::executed(
+        const std::string &sql, double seconds, int64_t rows, int64_t bytes) {
+    static const std::size_t capacity =
+            std::max<int64_t>(c_metric_statements.value(), 0);
+    std::lock_guard<std::mutex> lock{mutex};
+    total.add(seconds, rows, bytes);
+    auto found = statements.find(sql);
+    if (found != statements.end()) {
+        found->second.add(seconds, rows, bytes);
+    } else if (statements.size() < capacity) {
+        statements[sql].add(seconds, rows, bytes);
+    } else {
+        ++untracked;
+    }
+}
+
+
+void fostlib::pg::query_metrics::prepared(double seconds) {
+    std::lock_guard<std::mutex> lock{mutex};
+    ++prepares;
+    preparing += seconds;
+}
+
+
+fostlib::json fostlib::pg::query_metrics::snapshot() const {
+    json snap;
+    json bounds;
+    for (const auto b : command_figures::bounds) {
+        jcursor().push_back(bounds, b);
+    }
+    insert(snap, "histogram", bounds);
+    std::lock_guard<std::mutex> lock{mutex};
+    insert(snap, "total", total.as_json());
+    insert(snap, "prepared", "count", prepares);
+    insert(snap, "prepared", "seconds", preparing);
+    insert(snap, "untracked", untracked);
+    json by_sql;
+    for (const auto &s : statements) {
+        insert(by_sql, string(s.first), s.second.as_json());
+    }
+    insert(snap, "statements", by_sql);
+    if (const auto fields = decoded_fields.load(); fields) {
+        const double seconds = decode_nanoseconds.load() / 1e9;
+        insert(snap, "decode", "fields", fields);
+        insert(snap, "decode", "seconds", seconds);
+    }
+    return snap;
+}
+
+
+fostlib::pg::query_metrics &fostlib::pg::query_metrics::process() {
+    static query_metrics metrics;
+    return metrics;
+}
+
+
+bool fostlib::pg::query_metrics::enabled() { return c_query_metrics.value(); }
+double fostlib::pg::query_metrics::slow_query() {
+    return c_slow_query.value();
+}
+bool fostlib::pg::query_metrics::time_decoding() {
+    return c_time_decoding.value();
+}
@@ -0,0 +1,81 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// The latency and volume figures for commands
+        struct command_figures {
+            /// Upper bounds in seconds of the latency histogram buckets.
+            /// A final bucket counts the commands slower than all of them.
+            static constexpr std::array<double, 12> bounds{
+                    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                    0.05,   0.1,   0.25,   0.5,   1,    2.5};
+            std::array<int64_t, bounds.size() + 1> histogram{};
+            int64_t count = 0, rows = 0, bytes = 0;
+            double seconds = 0, slowest = 0;
+
+            void add(double seconds, int64_t rows, int64_t bytes);
+            json as_json() const;
+        };
+
+
+        /// Figures for the commands run on a connection, or across the
+        /// whole process. Commands are grouped by their SQL, up to the
+        /// "Query metrics statements" setting, after which new SQL is only
+        /// counted in the totals.
+        class query_metrics {
+            mutable std::mutex mutex;
+            command_figures total;
+            std::unordered_map<std::string, command_figures> statements;
+            int64_t untracked = 0, prepares = 0;
+            double preparing = 0;
+
+          public:
+            /// Time spent decoding fields. Only collected when the "Time
+            /// field decoding" setting is on, and only for the process
+            /// because records can outlive their connection.
+            std::atomic<int64_t> decode_nanoseconds{}, decoded_fields{};
+
+            void executed(
+                    const std::string &sql,
+                    double seconds,
+                    int64_t rows,
+                    int64_t bytes);
+            void prepared(double seconds);
+
+            json snapshot() const;
+
+            /// The figures for every connection in the process
+            static query_metrics &process();
+
+            /// The settings, which are read when a connection is opened
+            static bool enabled();
+            static double slow_query();
+            static bool time_decoding();
+        };
+
+
+    }
+
+
+}
@@ -0,0 +1,174 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/pending.hpp>
+#include <fost/pg/stored-procedure.hpp>
+#include "connection.hpp"
+#include "recordset.hpp"
+
+#include <fost/log>
+
+#include <chrono>
+
+
+struct fostlib::pg::pending::impl {
+    connection_reference cnx;
+    const std::string sql;
+    const std::chrono::steady_clock::time_point sent;
+    const std::size_t transaction;
+    const pqxx::pipeline::query_id id;
+    bool received = false;
+
+    impl(connection::impl &c, const std::string &s)
+    : cnx(c),
+      sql(s),
+      sent(std::chrono::steady_clock::now()),
+      transaction(c.transaction_number),
+      id(cnx->send(sql)) {}
+
+    /// True if the transaction has ended since the command was sent, in
+    /// which case its results were thrown away
+    bool abandoned() const { return transaction != cnx->transaction_number; }
+
+    /// The latency recorded is from sending the command to its results
+    /// being read
+    pqxx::result receive() {
+        if (abandoned()) {
+            throw exceptions::not_implemented(
+                    __FUNCTION__,
+                    "The transaction was rolled back before the results of "
+                    "the asynchronous command were read");
+        }
+        received = true;
+        auto result = cnx->receive(id);
+        if (cnx->measuring) {
+            cnx->executed(
+                    sql,
+                    std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - sent)
+                            .count(),
+                    result);
+        }
+        return result;
+    }
+};
+
+
+fostlib::pg::pending::pending(connection &cnx, const std::string &sql)
+: pimpl(std::make_unique<impl>(*cnx.pimpl, sql)) {}
+
+
+fostlib::pg::pending::pending(pending &&p) : pimpl(std::move(p.pimpl)) {}
+
+
+fostlib::pg::pending::~pending() {
+    if (pimpl && not pimpl->received && pimpl->cnx.alive()
+        && not pimpl->abandoned()) {
+        try {
+            pimpl->receive();
+        } catch (std::exception &e) {
+            fostlib::log::error(c_fost_pg)(
+                    "", "Error in discarded asynchronous command")(
+                    "sql", pimpl->sql.c_str())("exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+        }
+    }
+}
+
+
+bool fostlib::pg::pending::ready() {
+    if (pimpl->received || pimpl->abandoned()) {
+        return true;
+    } else {
+        pimpl->cnx->in_flight->resume();
+        return pimpl->cnx->in_flight->is_finished(pimpl->id);
+    }
+}
+
+
+fostlib::pg::recordset fostlib::pg::pending::get() {
+    if (pimpl->received) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "The results of an asynchronous command can only be read "
+                "once");
+    }
+    try {
+        return recordset(std::make_unique<recordset::impl>(pimpl->receive()));
+    } catch (std::exception &e) {
+        fostlib::log::error(c_fost_pg)("", "Error executing SQL command")(
+                "sql", pimpl->sql.c_str())("exception", "what", e.what())(
+                "exception", "type", typeid(e).name());
+        throw;
+    }
+}
+
+
+/*
+    fostlib::pg::connection::impl
+*/
+
+
+pqxx::pipeline::query_id
+        fostlib::pg::connection::impl::send(const std::string &sql) {
+    if (not in_flight) { in_flight = std::make_unique<pqxx::pipeline>(*trans); }
+    const auto id = in_flight->insert(sql);
+    ++in_flight_count;
+    return id;
+}
+
+
+pqxx::result
+        fostlib::pg::connection::impl::receive(pqxx::pipeline::query_id id) {
+    /// Once everything has been read the pipeline must be closed so that
+    /// the transaction can be used directly again
+    struct done {
+        connection::impl &cnx;
+        ~done() {
+            if (--cnx.in_flight_count == 0) { cnx.in_flight.reset(); }
+        }
+    } finished{*this};
+    return in_flight->retrieve(id);
+}
+
+
+void fostlib::pg::connection::impl::abandon_in_flight() noexcept {
+    if (in_flight) {
+        try {
+            in_flight->complete();
+        } catch (std::exception &e) {
+            fostlib::log::error(c_fost_pg)(
+                    "", "Error abandoning asynchronous commands")(
+                    "commands", int64_t(in_flight_count))(
+                    "exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+        }
+        in_flight.reset();
+        in_flight_count = 0;
+    }
+}
+
+
+/*
+    Starting asynchronous commands
+*/
+
+
+fostlib::pg::pending
+        fostlib::pg::connection::exec_async(const utf8_string &sql) {
+    return pending(*this, static_cast<std::string>(sql));
+}
+
+
+int fostlib::pg::connection::socket() const { return pimpl->pqcnx.sock(); }
+
+
+fostlib::pg::pending fostlib::pg::unbound_procedure::exec_async(
+        const std::vector<fostlib::json> &args) {
+    return pending(cnx, execute_sql(*cnx.pimpl->trans, name, args));
+}
@@ -0,0 +1,122 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/pipeline.hpp>
+#include <fost/pg/stored-procedure.hpp>
+#include "connection.hpp"
+#include "recordset.hpp"
+
+#include <fost/log>
+#include <pqxx/pipeline>
+
+#include <chrono>
+
+
+struct fostlib::pg::pipeline::impl {
+    connection::impl &cnx;
+    std::vector<std::string> commands;
+
+    impl(connection::impl &c) : cnx(c) {}
+
+    std::size_t queue(std::string sql) {
+        commands.push_back(std::move(sql));
+        return commands.size() - 1;
+    }
+};
+
+
+fostlib::pg::pipeline::pipeline(connection &cnx)
+: pimpl(std::make_unique<impl>(*cnx.pimpl)) {}
+fostlib::pg::pipeline::pipeline(pipeline &&p) : pimpl(std::move(p.pimpl)) {}
+fostlib::pg::pipeline::~pipeline() = default;
+
+
+fostlib::pg::pipeline::failed::failed(
+        std::size_t s, const std::string &q, const char *what)
+: std::runtime_error(what), statement(s), sql(q) {}
+
+
+std::size_t fostlib::pg::pipeline::exec(const utf8_string &sql) {
+    return pimpl->queue(static_cast<std::string>(sql));
+}
+
+
+std::size_t
+        fostlib::pg::pipeline::select(const char *relation, const json &keys) {
+    return select(relation, keys, json::array_t());
+}
+std::size_t fostlib::pg::pipeline::select(
+        const char *relation, const json &keys, const json &order) {
+    auto &trans = *pimpl->cnx.trans;
+    return pimpl->queue(static_cast<std::string>(select_sql(
+            relation, keys, order,
+            [&trans](const json &v) { return literal(trans, v); })));
+}
+
+
+std::size_t fostlib::pg::pipeline::exec(
+        const unbound_procedure &procedure, const std::vector<json> &args) {
+    return pimpl->queue(
+            execute_sql(*pimpl->cnx.trans, procedure.name, args));
+}
+
+
+std::size_t fostlib::pg::pipeline::size() const {
+    return pimpl->commands.size();
+}
+
+
+std::vector<fostlib::pg::recordset> fostlib::pg::pipeline::sync() {
+    std::vector<recordset> results;
+    auto commands = std::move(pimpl->commands);
+    pimpl->commands.clear();
+    if (commands.empty()) { return results; }
+    results.reserve(commands.size());
+
+    /// `pqxx::pipeline` joins the commands into a single simple query, so
+    /// only plain SQL can be queued. This is why values are quoted into
+    /// the SQL rather than bound
+    pqxx::pipeline batch(*pimpl->cnx.trans);
+    /// Hold all of the commands back until they are complete so that they
+    /// go to the server together
+    batch.retain(static_cast<int>(commands.size()));
+    std::vector<pqxx::pipeline::query_id> ids;
+    ids.reserve(commands.size());
+    const auto started = std::chrono::steady_clock::now();
+    for (const auto &sql : commands) { ids.push_back(batch.insert(sql)); }
+    batch.complete();
+    /// Every command waits for the whole batch, so they are all recorded
+    /// as taking the time it took to sync
+    const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - started)
+                                   .count();
+
+    for (std::size_t index{}; index != ids.size(); ++index) {
+        try {
+            auto result = batch.retrieve(ids[index]);
+            if (pimpl->cnx.measuring) {
+                pimpl->cnx.executed(commands[index], seconds, result);
+            }
+            results.push_back(recordset(
+                    std::make_unique<recordset::impl>(std::move(result))));
+        } catch (std::exception &e) {
+            fostlib::log::error(c_fost_pg)("", "Error executing SQL command")(
+                    "pipeline", "statement", int64_t(index))(
+                    "sql", commands[index].c_str())(
+                    "exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+            throw failed(index, commands[index], e.what());
+        }
+    }
+    return results;
+}
+
+
+fostlib::pg::pipeline fostlib::pg::connection::queue() {
+    return pipeline(*this);
+}
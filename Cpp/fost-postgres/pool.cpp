@@ -0,0 +1,300 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/pool.hpp>
+#include "connection.hpp"
+
+#include <fost/insert>
+#include <fost/log>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+
+namespace {
+
+
+    using clock_type = std::chrono::steady_clock;
+
+
+    const char *const c_reset_session =
+            "RESET ALL; UNLISTEN *; CLOSE ALL; DISCARD TEMP";
+
+
+    template<typename T>
+    T option(const fostlib::json &conf, const char *key, T dflt) {
+        if (conf.has_key("pool") && conf["pool"].has_key(key)) {
+            return fostlib::coerce<T>(conf["pool"][key]);
+        } else {
+            return dflt;
+        }
+    }
+
+    clock_type::duration seconds(double s) {
+        return std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(s));
+    }
+    double seconds(clock_type::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+
+}
+
+
+struct fostlib::pg::pool::impl {
+    const json configuration;
+    const std::size_t min_size, max_size;
+    const clock_type::duration idle_timeout, wait_timeout;
+
+    std::mutex mutex;
+    std::condition_variable available;
+
+    struct idle_connection {
+        std::unique_ptr<connection> cnx;
+        clock_type::time_point since;
+    };
+    /// Idle connections, most recently returned at the back
+    std::vector<idle_connection> idle;
+    /// Connections counted against `max_size`, whether idle, leased or
+    /// in the process of being opened
+    std::size_t open = 0;
+    std::size_t leased = 0;
+
+    /// Counters reported by `statistics`
+    int64_t acquired = 0, created = 0, waits = 0, timeouts = 0, evicted = 0,
+            unhealthy = 0;
+    std::size_t peak_leased = 0;
+    clock_type::duration wait_total{}, wait_max{};
+
+    impl(const json &conf)
+    : configuration(conf),
+      min_size(option<int64_t>(conf, "min", 0)),
+      max_size(std::max<int64_t>(
+              option<int64_t>(conf, "max", 10),
+              std::max<int64_t>(min_size, 1))),
+      idle_timeout(seconds(option<double>(conf, "idle", 60))),
+      wait_timeout(seconds(option<double>(conf, "wait", 5))) {}
+
+    /// Open connections until there are at least `min_size`. Each slot is
+    /// reserved first and the connection made without holding the lock.
+    void fill() {
+        std::unique_lock<std::mutex> lock{mutex};
+        while (open < min_size) {
+            ++open;
+            lock.unlock();
+            std::unique_ptr<connection> cnx;
+            try {
+                cnx = std::make_unique<connection>(configuration);
+            } catch (...) {
+                lock.lock();
+                --open;
+                throw;
+            }
+            lock.lock();
+            ++created;
+            idle.push_back({std::move(cnx), clock_type::now()});
+            available.notify_one();
+        }
+    }
+
+    /// Remove connections that have been idle for too long. The caller
+    /// must hold the lock, and should destroy the returned connections
+    /// after releasing it.
+    std::vector<std::unique_ptr<connection>>
+            evict(clock_type::time_point now) {
+        std::vector<std::unique_ptr<connection>> closing;
+        /// The oldest idle connections are at the front
+        auto expired = idle.begin();
+        while (expired != idle.end() && open - closing.size() > min_size
+               && now - expired->since > idle_timeout) {
+            closing.push_back(std::move(expired->cnx));
+            ++expired;
+        }
+        idle.erase(idle.begin(), expired);
+        open -= closing.size();
+        evicted += closing.size();
+        return closing;
+    }
+
+    void release(std::unique_ptr<connection> cnx) noexcept {
+        /// The session is put back how it was when it was opened so the
+        /// next borrower doesn't see the settings, listens, cursors or
+        /// temporary tables of this one. `DISCARD ALL` would also drop the
+        /// prepared statements the connection has cached. The round trips
+        /// also tell us the connection is still usable.
+        bool healthy = false;
+        try {
+            cnx->rollback();
+            cnx->exec(c_reset_session);
+            cnx->commit();
+            healthy = true;
+        } catch (std::exception &e) {
+            fostlib::log::warning(c_fost_pg)(
+                    "", "Discarding pooled connection after failed reset")(
+                    "exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+        }
+        std::vector<std::unique_ptr<connection>> closing;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            --leased;
+            const auto now = clock_type::now();
+            if (healthy) {
+                idle.push_back({std::move(cnx), now});
+            } else {
+                --open;
+                ++unhealthy;
+            }
+            closing = evict(now);
+        }
+        available.notify_one();
+    }
+};
+
+
+/**
+    ## fostlib::pg::pool
+*/
+
+
+fostlib::pg::pool::pool(const json &conf) {
+    static std::mutex mutex;
+    static std::map<string, std::shared_ptr<impl>> pools;
+    const auto key = json::unparse(dsn_from_json(conf).second, false);
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto &p = pools[key];
+        if (not p) {
+            p = std::make_shared<impl>(conf);
+        } else if (
+                conf.has_key("pool")
+                && (not p->configuration.has_key("pool")
+                    || conf["pool"] != p->configuration["pool"])) {
+            throw exceptions::not_implemented(
+                    __FUNCTION__,
+                    "There is already a pool for this configuration with "
+                    "different pool options");
+        }
+        pimpl = p;
+    }
+    /// Connecting can be slow, so it mustn't hold up the other pools
+    pimpl->fill();
+}
+
+
+fostlib::pg::pool::exhausted::exhausted()
+: std::runtime_error(
+        "No database connection became available from the pool") {}
+
+
+fostlib::pg::pool::lease fostlib::pg::pool::acquire() {
+    const auto started = clock_type::now();
+    /// Evicted connections must be closed after the lock is released
+    std::vector<std::unique_ptr<connection>> closing;
+    std::unique_lock<std::mutex> lock{pimpl->mutex};
+    closing = pimpl->evict(started);
+    if (pimpl->idle.empty() && pimpl->open >= pimpl->max_size) {
+        ++pimpl->waits;
+        const bool ready = pimpl->available.wait_until(
+                lock, started + pimpl->wait_timeout, [this]() {
+                    return not pimpl->idle.empty()
+                            || pimpl->open < pimpl->max_size;
+                });
+        const auto waited = clock_type::now() - started;
+        pimpl->wait_total += waited;
+        pimpl->wait_max = std::max(pimpl->wait_max, waited);
+        if (not ready) {
+            ++pimpl->timeouts;
+            throw exhausted();
+        }
+    }
+    ++pimpl->acquired;
+    pimpl->peak_leased = std::max(pimpl->peak_leased, ++pimpl->leased);
+    if (not pimpl->idle.empty()) {
+        auto cnx = std::move(pimpl->idle.back().cnx);
+        pimpl->idle.pop_back();
+        return lease(pimpl, std::move(cnx));
+    }
+    /// Reserve the slot and then connect without holding the lock
+    ++pimpl->open;
+    lock.unlock();
+    try {
+        auto cnx = std::make_unique<connection>(pimpl->configuration);
+        lock.lock();
+        ++pimpl->created;
+        return lease(pimpl, std::move(cnx));
+    } catch (...) {
+        if (not lock.owns_lock()) { lock.lock(); }
+        --pimpl->open;
+        --pimpl->leased;
+        lock.unlock();
+        pimpl->available.notify_one();
+        throw;
+    }
+}
+
+
+std::size_t fostlib::pg::pool::leased() const {
+    std::lock_guard<std::mutex> lock{pimpl->mutex};
+    return pimpl->leased;
+}
+
+
+fostlib::json fostlib::pg::pool::statistics() const {
+    std::lock_guard<std::mutex> lock{pimpl->mutex};
+    json stats;
+    insert(stats, "configuration",
+           dsn_from_json(pimpl->configuration).second);
+    insert(stats, "size", "min", int64_t(pimpl->min_size));
+    insert(stats, "size", "max", int64_t(pimpl->max_size));
+    insert(stats, "connections", "open", int64_t(pimpl->open));
+    insert(stats, "connections", "idle", int64_t(pimpl->idle.size()));
+    insert(stats, "connections", "leased", int64_t(pimpl->leased));
+    insert(stats, "connections", "peak", int64_t(pimpl->peak_leased));
+    insert(stats, "connections", "created", pimpl->created);
+    insert(stats, "connections", "evicted", pimpl->evicted);
+    insert(stats, "connections", "unhealthy", pimpl->unhealthy);
+    insert(stats, "utilization",
+           pimpl->max_size ? double(pimpl->leased) / pimpl->max_size : 0.0);
+    insert(stats, "acquire", "count", pimpl->acquired);
+    insert(stats, "acquire", "waits", pimpl->waits);
+    insert(stats, "acquire", "timeouts", pimpl->timeouts);
+    insert(stats, "acquire", "wait", "total", seconds(pimpl->wait_total));
+    insert(stats, "acquire", "wait", "max", seconds(pimpl->wait_max));
+    return stats;
+}
+
+
+/**
+    ## fostlib::pg::pool::lease
+*/
+
+
+fostlib::pg::pool::lease::lease(
+        std::shared_ptr<pool::impl> p, std::unique_ptr<connection> c)
+: owner(std::move(p)), cnx(std::move(c)) {}
+
+
+fostlib::pg::pool::lease::lease(lease &&l)
+: owner(std::move(l.owner)), cnx(std::move(l.cnx)) {}
+
+
+fostlib::pg::pool::lease &fostlib::pg::pool::lease::operator=(lease &&l) {
+    if (owner && cnx) { owner->release(std::move(cnx)); }
+    owner = std::move(l.owner);
+    cnx = std::move(l.cnx);
+    return *this;
+}
+
+
+fostlib::pg::pool::lease::~lease() {
+    if (owner && cnx) { owner->release(std::move(cnx)); }
+}
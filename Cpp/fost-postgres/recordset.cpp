@@ -7,19 +7,82 @@
 
 
 #include <fost/core>
-#include <fost/exception/parse_error.hpp>
+#include <fost/exception/out_of_range.hpp>
 #include <fost/log>
-#include <fost/parse/parse.hpp>
 #include <fost/pg/recordset.hpp>
 #include "recordset.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
 
 /**
     ## fostlib::pg::record
 */
 
 
-fostlib::pg::record::record(std::size_t columns) : fields(columns) {}
+fostlib::pg::record::record(std::size_t columns)
+: fields(columns), decoded(columns) {}
+
+
+void fostlib::pg::record::decode(std::size_t index) const {
+    const auto field = src->row[index];
+    if (field.is_null()) {
+        fields[index] = json();
+    } else if (src->layout->timed) {
+        const auto started = std::chrono::steady_clock::now();
+        fields[index] = src->layout->decoders[index](
+                field.type(), std::string_view{field.c_str(), field.size()});
+        auto &metrics = query_metrics::process();
+        metrics.decode_nanoseconds +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+        ++metrics.decoded_fields;
+    } else {
+        fields[index] = src->layout->decoders[index](
+                field.type(), std::string_view{field.c_str(), field.size()});
+    }
+    decoded[index] = true;
+}
+
+
+const fostlib::json &
+        fostlib::pg::record::operator[](const string &name) const {
+    return (*this)[src->layout->index_of(static_cast<std::string>(name))];
+}
+
+
+std::optional<std::string_view>
+        fostlib::pg::record::raw(std::size_t index) const {
+    const auto field = src->row[index];
+    if (field.is_null()) {
+        return {};
+    } else {
+        return std::string_view{field.c_str(), field.size()};
+    }
+}
+
+
+std::optional<std::string_view> fostlib::pg::record::bytes(
+        std::size_t index, std::vector<unsigned char> &buffer) const {
+    const auto field = src->row[index];
+    if (field.is_null()) { return {}; }
+    if (not decoder<std::vector<unsigned char>>::accepts(field.type())) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "Only bytea fields can be read as bytes, but column "
+                        + coerce<string>(int64_t(index)) + " has type OID "
+                        + coerce<string>(int64_t(field.type())));
+    }
+    const std::string_view sent{field.c_str(), field.size()};
+    if (src->layout->binary) { return sent; }
+    buffer.clear();
+    bytea_from_text(sent, buffer);
+    return std::string_view{
+            reinterpret_cast<const char *>(buffer.data()), buffer.size()};
+}
 
 
 /**
@@ -40,145 +103,321 @@ fostlib::pg::recordset::~recordset() {}
 
 std::vector<fostlib::nullable<fostlib::string>>
         fostlib::pg::recordset::columns() const {
-    std::vector<fostlib::nullable<fostlib::string>> names;
-    names.reserve(pimpl->names.size());
+    return pimpl->layout->names;
+}
+
+
+/*
+    fostlib::pg::column_layout
+*/
+
+
+fostlib::pg::column_layout::column_layout(
+        const pqxx::result &records,
+        const std::vector<pqxx::oid> &types,
+        bool binary)
+: binary(binary), timed(query_metrics::time_decoding()) {
+    decoders.reserve(types.size());
+    for (const auto oid : types) {
+#ifdef DEBUG
+        if (not binary && not decoder<json>::known(oid)) {
+            log::warning(c_fost_pg)(
+                    "", "Postgres type decoding -- unknown type OID")(
+                    "oid", oid);
+        }
+#endif
+        decoders.push_back(
+                binary ? decoder<json>::plan_binary(oid)
+                       : decoder<json>::plan(oid));
+    }
+    names.reserve(types.size());
     std::map<int64_t, fostlib::string> oid_prefix;
-    for (auto c : pimpl->names) {
+    for (std::size_t column{}; column != types.size(); ++column) {
+        const char *c = records.column_name(column);
         if (c == nullptr || c[0] == 0) {
             names.push_back(fostlib::null);
         } else {
-            const string colname{c};
-            const auto table =
-                    pimpl->records.column_table(coerce<int>(names.size()));
+            string colname{c};
+            const auto table = records.column_table(coerce<int>(column));
             if (colname.endswith("__tableoid")) {
                 oid_prefix[table] =
                         colname.substr(0, colname.code_points() - 8);
-                names.push_back(colname);
             } else if (oid_prefix.find(table) != oid_prefix.end()) {
-                names.push_back(oid_prefix[table] + colname);
-            } else {
-                names.push_back(colname);
+                colname = oid_prefix[table] + colname;
             }
+            names.push_back(colname);
+            index.emplace(static_cast<std::string>(colname), column);
         }
     }
-    return names;
 }
 
 
-fostlib::pg::recordset::const_iterator fostlib::pg::recordset::begin() const {
-    return fostlib::pg::recordset::const_iterator(*pimpl, true);
+std::size_t
+        fostlib::pg::column_layout::index_of(const std::string &name) const {
+    if (auto found = index.find(name); found != index.end()) {
+        return found->second;
+    } else {
+        throw exceptions::null(
+                "There is no column with this name", string(name));
+    }
 }
-fostlib::pg::recordset::const_iterator fostlib::pg::recordset::end() const {
-    return fostlib::pg::recordset::const_iterator(*pimpl, false);
+
+
+/*
+    fostlib::pg::recordset::impl::cursor
+*/
+
+
+fostlib::pg::recordset::impl::cursor::cursor(
+        connection::impl &c,
+        const utf8_string &sql,
+        std::size_t batch,
+        bool b)
+: cnx(c),
+  name([]() {
+      static std::atomic<unsigned int> number;
+      return "fost_cursor_" + std::to_string(++number);
+  }()),
+  sql(static_cast<std::string>(sql)),
+  batch_rows(batch),
+  binary(b),
+  transaction(c.transaction_number),
+  /// Without a transaction the cursor has to be held open after the
+  /// statement that declares it
+  hold(c.level == connection::impl::isolation::none) {
+    cnx->trans->exec(
+            "DECLARE " + name + (binary ? " BINARY" : "")
+            + " NO SCROLL CURSOR" + (hold ? " WITH HOLD" : "") + " FOR "
+            + static_cast<std::string>(sql));
+}
+
+
+fostlib::pg::recordset::impl::cursor::~cursor() {
+    /// A cursor held open outside of a transaction lasts as long as the
+    /// session, so it is always closed. Otherwise it only needs closing if
+    /// its transaction is still running.
+    if (open && cnx.alive()
+        && (hold || transaction == cnx->transaction_number)) {
+        try {
+            cnx->trans->exec("CLOSE " + name);
+        } catch (std::exception &e) {
+            fostlib::log::warning(c_fost_pg)("", "Error closing cursor")(
+                    "cursor", name)("exception", "what", e.what());
+        }
+    }
+}
+
+
+pqxx::result fostlib::pg::recordset::impl::cursor::fetch() {
+    if (not hold && transaction != cnx->transaction_number) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "A streamed recordset can't be read after its transaction "
+                "has been committed or rolled back");
+    }
+    auto page = cnx->measured(sql, [this]() {
+        return cnx->trans->exec(
+                (batch_rows ? "FETCH FORWARD " + std::to_string(batch_rows)
+                            : std::string{"FETCH ALL"})
+                + " FROM " + name);
+    });
+    if (batch_rows == 0 || page.size() < batch_rows) {
+        cnx->trans->exec("CLOSE " + name);
+        open = false;
+    }
+    return page;
 }
 
 
 /*
-    fostlib::pg::recordset::const_iterator
+    fostlib::pg::recordset::impl::keyset
 */
 
 
-namespace {
-    int64_t int_parser(const std::string &value) {
-        int64_t ret{0};
-        auto pos = value.begin();
-        if (not boost::spirit::qi::parse(
-                    pos, value.end(), boost::spirit::qi::int_parser<int64_t>(),
-                    ret)
-            && pos == value.end()) {
-            throw fostlib::exceptions::parse_error(
-                    "Whilst parsing an int", value);
-        } else {
-            return ret;
+fostlib::pg::recordset::impl::keyset::keyset(
+        connection::impl &c,
+        const char *relation,
+        const json &filter,
+        const std::vector<fostlib::string> &order,
+        std::size_t ps,
+        const std::vector<fostlib::string> &columns)
+: cnx(c), page_size(std::max<std::size_t>(ps, 1)), keys([&order]() {
+      std::vector<std::string> k;
+      for (const auto &o : order) { k.push_back(static_cast<std::string>(o)); }
+      return k;
+  }()) {
+    std::string what, where, ordering, after, values;
+    for (const auto &column : columns) {
+        if (not what.empty()) { what += ", "; }
+        what += static_cast<std::string>(column);
+    }
+    /// The keys are needed to find where the next page starts
+    for (const auto &key : keys) {
+        if (not columns.empty()
+            && std::find(columns.begin(), columns.end(), fostlib::string(key))
+                    == columns.end()) {
+            what += ", " + key;
         }
     }
-    double float_parser(const std::string &value) {
-        double ret{0};
-        auto pos = value.begin();
-        if (not boost::spirit::qi::parse(
-                    pos, value.end(), boost::spirit::qi::double_, ret)
-            && pos == value.end()) {
-            throw fostlib::exceptions::parse_error(
-                    "Whilst parsing a double", value);
+    for (json::const_iterator iter(filter.begin()); iter != filter.end();
+         ++iter) {
+        args.push_back(parameter(*iter));
+        where += (where.empty() ? " WHERE " : " AND ")
+                + static_cast<std::string>(coerce<string>(iter.key()))
+                + " = $" + std::to_string(args.size());
+    }
+    filters = args.size();
+    args.push_back(std::to_string(page_size));
+    const auto limit = " LIMIT $" + std::to_string(args.size());
+    for (std::size_t index{}; index != keys.size(); ++index) {
+        const auto placeholder = "$" + std::to_string(args.size() + 1 + index);
+        ordering += (index ? ", " : " ORDER BY ") + keys[index];
+        after += (index ? ", " : "") + keys[index];
+        values += (index ? ", " : "") + placeholder;
+    }
+    const auto select = "SELECT " + (what.empty() ? std::string{"*"} : what)
+            + " FROM " + relation;
+    first = select + where + ordering + limit;
+    next = select + (where.empty() ? " WHERE " : where + " AND ") + "("
+            + after + ") > (" + values + ")" + ordering + limit;
+}
+
+
+pqxx::result fostlib::pg::recordset::impl::keyset::fetch() {
+    auto page =
+            cnx->exec_cached(args.size() > filters + 1 ? next : first, args);
+    if (page.size() < page_size) {
+        open = false;
+        return page;
+    }
+    if (positions.empty()) {
+        for (const auto &key : keys) {
+            positions.push_back(page.column_number(key));
+        }
+    }
+    const auto last = page[page.size() - 1];
+    args.resize(filters + 1);
+    for (const auto position : positions) {
+        const auto field = last[position];
+        if (field.is_null()) {
+            args.push_back(std::nullopt);
         } else {
-            return ret;
+            args.emplace_back(std::in_place, field.c_str(), field.size());
         }
     }
+    return page;
+}
 
-    void
-            fillin(const std::vector<pqxx::oid> &types,
-                   pqxx::result::const_iterator pos,
-                   std::vector<fostlib::json> &fields) {
-        for (pqxx::row::size_type index{0}; index != fields.size(); ++index) {
-            if (pos[index].is_null()) {
-                fields[index] = fostlib::json();
-            } else {
-                switch (types[index]) {
-                case 16: // bool
-                    fields[index] = fostlib::json(
-                            pos[index].c_str()[0] == 't' ? true : false);
-                    break;
-                case 21: // int2
-                case 23: // int4
-                case 20: // int8
-                case 26: // oid
-                    fields[index] =
-                            fostlib::json(int_parser(pos[index].c_str()));
-                    break;
-                case 700: // float4
-                case 701: // float8
-                    fields[index] =
-                            fostlib::json(float_parser(pos[index].c_str()));
-                    break;
-                case 114: // json
-                case 3802: // jsonb
-                    fields[index] = fostlib::json::parse(pos[index].c_str());
-                    break;
-                case 1114: // timestamp without time zone
-                    throw fostlib::exceptions::not_implemented(
-                            __FUNCTION__,
-                            "Timestamp fields without time zones are "
-                            "explicitly disabled. "
-                            "Fix your schema to use 'timestamp with time "
-                            "zone'");
-                default:
-#ifdef DEBUG
-                    fostlib::log::warning(fostlib::pg::c_fost_pg)(
-                            "", "Postgres type decoding -- unknown type OID")(
-                            "oid", types[index]);
-#endif
-                case 25: // text
-                case 1043: // varchar
-                case 1082: // date
-                case 1083: // time
-                case 1184: // timestamp with time zone
-                case 1700: // numeric
-                case 2950: // uuid
-                    fields[index] =
-                            fostlib::coerce<fostlib::json>(pos[index].c_str());
-                }
-            }
+
+const std::vector<unsigned int> &fostlib::pg::recordset::column_types() const {
+    return pimpl->types;
+}
+
+
+void fostlib::pg::recordset::check_text() const {
+    if (pimpl->binary) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "Typed and columnar access needs a text format recordset");
+    }
+}
+
+
+void fostlib::pg::recordset::check_columns(
+        std::initializer_list<bool (*)(unsigned int)> accepts) const {
+    check_text();
+    if (accepts.size() != pimpl->types.size()) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "The number of types requested doesn't match the number of "
+                "columns in the recordset");
+    }
+    std::size_t index{};
+    for (const auto accept : accepts) {
+        if (not accept(pimpl->types[index])) {
+            throw exceptions::not_implemented(
+                    __FUNCTION__,
+                    "The type requested for column "
+                            + coerce<string>(int64_t(index))
+                            + " can't be decoded from type OID "
+                            + coerce<string>(int64_t(pimpl->types[index])));
         }
+        ++index;
     }
 }
 
 
+void fostlib::pg::recordset::check_column(
+        std::size_t index, bool (*accept)(unsigned int)) const {
+    check_text();
+    if (index >= pimpl->types.size()) {
+        throw exceptions::out_of_range<std::size_t>(
+                "Column number is out of range", 0, pimpl->types.size(),
+                index);
+    } else if (not accept(pimpl->types[index])) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "The type requested for column "
+                        + coerce<string>(int64_t(index))
+                        + " can't be decoded from type OID "
+                        + coerce<string>(int64_t(pimpl->types[index])));
+    }
+}
+
+
+std::size_t fostlib::pg::recordset::size_hint() const {
+    std::size_t rows{};
+    for (const auto &page : pimpl->pages) { rows += page.size(); }
+    return rows;
+}
+
+
+std::size_t fostlib::pg::recordset::index_of(const string &name) const {
+    return pimpl->layout->index_of(static_cast<std::string>(name));
+}
+
+
+fostlib::pg::recordset::const_iterator fostlib::pg::recordset::begin() const {
+    return fostlib::pg::recordset::const_iterator(*pimpl, true);
+}
+fostlib::pg::recordset::const_iterator fostlib::pg::recordset::end() const {
+    return fostlib::pg::recordset::const_iterator(*pimpl, false);
+}
+
+
+/*
+    fostlib::pg::recordset::const_iterator
+*/
+
+
 fostlib::pg::recordset::const_iterator::const_iterator()
 : pimpl(new impl(pqxx::result::const_iterator(), 0u)) {}
 fostlib::pg::recordset::const_iterator::const_iterator(
         const const_iterator &other)
 : pimpl(new impl(
-        other.pimpl->rs, other.pimpl->position, other.pimpl->row.size())) {
+        other.pimpl->rs,
+        other.pimpl->page,
+        other.pimpl->position,
+        other.pimpl->done,
+        other.pimpl->row.size())) {
+    pimpl->records = other.pimpl->records;
     pimpl->row = other.pimpl->row;
 }
 fostlib::pg::recordset::const_iterator::const_iterator(
-        recordset::impl &rs, bool begin)
+        recordset::impl &rs, bool begin, bool records)
 : pimpl(new impl(
-        &rs,
-        begin ? rs.records.begin() : rs.records.end(),
-        rs.records.columns())) {
-    if (pimpl->position != rs.records.end()) {
-        fillin(rs.types, pimpl->position, pimpl->row.fields);
+        &rs, rs.first_page, pqxx::result::const_iterator(), true,
+        rs.types.size())) {
+    pimpl->records = records;
+    if (begin && rs.first_page) {
+        throw exceptions::not_implemented(
+                __FUNCTION__,
+                "Streamed recordsets can only be iterated once");
+    }
+    if (begin && not rs.pages.empty()) {
+        pimpl->position = rs.pages.front().begin();
+        pimpl->skip_empty();
+        if (not pimpl->done && pimpl->records) { pimpl->load(); }
     }
 }
 
@@ -190,7 +429,9 @@ fostlib::pg::recordset::const_iterator &
         fostlib::pg::recordset::const_iterator::operator=(
                 const fostlib::pg::recordset::const_iterator &other) {
     pimpl.reset(new impl(
-            other.pimpl->rs, other.pimpl->position, other.pimpl->row.size()));
+            other.pimpl->rs, other.pimpl->page, other.pimpl->position,
+            other.pimpl->done, other.pimpl->row.size()));
+    pimpl->records = other.pimpl->records;
     pimpl->row = other.pimpl->row;
     return *this;
 }
@@ -199,13 +440,29 @@ fostlib::pg::recordset::const_iterator &
 bool fostlib::pg::recordset::const_iterator::operator==(
         const const_iterator &other) const {
     if (pimpl && other.pimpl) {
-        return pimpl->position == other.pimpl->position;
+        if (pimpl->done || other.pimpl->done) {
+            return pimpl->done == other.pimpl->done;
+        } else {
+            return pimpl->page == other.pimpl->page
+                    && pimpl->position == other.pimpl->position;
+        }
     } else {
         return pimpl == other.pimpl;
     }
 }
 
 
+std::optional<std::string_view>
+        fostlib::pg::recordset::const_iterator::text(std::size_t index) const {
+    const auto field = pimpl->position[index];
+    if (field.is_null()) {
+        return {};
+    } else {
+        return std::string_view{field.c_str(), field.size()};
+    }
+}
+
+
 const fostlib::pg::record *
         fostlib::pg::recordset::const_iterator::operator->() const {
     return &pimpl->row;
@@ -218,9 +475,9 @@ const fostlib::pg::record &
 
 fostlib::pg::recordset::const_iterator &
         fostlib::pg::recordset::const_iterator::operator++() {
-    if (++pimpl->position != pimpl->rs->records.end()) {
-        fillin(pimpl->rs->types, pimpl->position, pimpl->row.fields);
-    }
+    ++pimpl->position;
+    pimpl->skip_empty();
+    if (not pimpl->done && pimpl->records) { pimpl->load(); }
     return *this;
 }
 fostlib::pg::recordset::const_iterator
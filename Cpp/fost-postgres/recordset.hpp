@@ -13,36 +13,232 @@
 #include "connection.hpp"
 #include <pqxx/result>
 
+#include <unordered_map>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// Everything about the columns that is worked out once for each
+        /// recordset. It is shared with the records so they can outlive
+        /// the recordset.
+        struct column_layout {
+            /// The decoder for each column
+            std::vector<decoder<json>::function> decoders;
+            /// The column names as given by `recordset::columns`
+            std::vector<nullable<string>> names;
+            /// The index of the first column with each name
+            std::unordered_map<std::string, std::size_t> index;
+            /// True when the fields are in the binary format
+            const bool binary;
+            /// Set when the time spent decoding fields is to be recorded
+            const bool timed;
+
+            column_layout(
+                    const pqxx::result &,
+                    const std::vector<pqxx::oid> &types,
+                    bool binary);
+
+            /// The index of the named column. Throws if there isn't one
+            std::size_t index_of(const std::string &name) const;
+        };
+
+
+    }
+
+
+}
+
 
 struct fostlib::pg::recordset::impl {
-    pqxx::result records;
+    /// The results that make up the recordset, in order. All of them have
+    /// the same columns. When streaming only the most recently fetched
+    /// page is kept.
+    std::vector<pqxx::result> pages;
+    /// The page number of the first page in `pages`
+    std::size_t first_page = 0;
     std::vector<pqxx::oid> types;
     std::vector<const char *> names;
+    /// True when the fields are in the binary format
+    const bool binary;
+    std::shared_ptr<const column_layout> layout;
+
+    /// Somewhere that further pages are fetched from
+    struct pager {
+        bool open = true;
+
+        virtual ~pager() = default;
+        /// Fetch the next page. The pager is closed once it is exhausted
+        virtual pqxx::result fetch() = 0;
+    };
+
+    /// A server side cursor that further pages are fetched from
+    struct cursor final : pager {
+        connection_reference cnx;
+        const std::string name;
+        /// The SQL the cursor is for, which its pages are measured against
+        const std::string sql;
+        /// The number of rows to fetch at a time, zero for all of them
+        const std::size_t batch_rows;
+        const bool binary;
+        /// The connection transaction the cursor was declared in
+        const std::size_t transaction;
+        /// Held cursors outlive their transaction, which they need to do
+        /// when each command is run on its own
+        const bool hold;
+
+        cursor(connection::impl &,
+               const utf8_string &sql,
+               std::size_t,
+               bool binary = false);
+        ~cursor();
+
+        pqxx::result fetch() override;
+    };
+
+    /// Fetches pages with separate queries, each starting after the keys
+    /// of the last row of the page before
+    struct keyset final : pager {
+        connection_reference cnx;
+        /// The SQL for the first page and for the pages after it
+        std::string first, next;
+        /// The filter values, followed by the page size and then the keys
+        /// of the last row once there is one
+        std::vector<std::optional<std::string>> args;
+        std::size_t filters;
+        const std::size_t page_size;
+        const std::vector<std::string> keys;
+        /// The result columns the keys are in
+        std::vector<pqxx::row::size_type> positions;
+
+        keyset(connection::impl &,
+               const char *relation,
+               const json &filter,
+               const std::vector<fostlib::string> &order,
+               std::size_t page_size,
+               const std::vector<fostlib::string> &columns);
+
+        pqxx::result fetch() override;
+    };
 
-    impl(pqxx::result &&recs)
-    : records(std::move(recs)),
-      types(records.columns()),
-      names(records.columns()) {
-        for (pqxx::row::size_type index{0}; index != types.size(); ++index) {
-            types[index] = records.column_type(index);
-            names[index] = records.column_name(index);
+    std::unique_ptr<pager> stream;
+
+    impl(std::vector<pqxx::result> &&p, bool bin = false)
+    : pages(std::move(p)), binary(bin) {
+        if (not pages.empty()) {
+            const auto &records = pages.front();
+            types.resize(records.columns());
+            names.resize(records.columns());
+            for (pqxx::row::size_type index{0}; index != types.size();
+                 ++index) {
+                types[index] = records.column_type(index);
+                names[index] = records.column_name(index);
+            }
+            layout = std::make_shared<column_layout>(records, types, binary);
+        } else {
+            layout = std::make_shared<column_layout>(
+                    pqxx::result{}, types, binary);
         }
     }
+    impl(pqxx::result &&recs) : impl(single(std::move(recs))) {}
 
     impl(connection::impl &cnx, const utf8_string &sql)
-    : impl(cnx.trans->exec(static_cast<std::string>(sql))) {}
+    : impl(cnx.measured(static_cast<std::string>(sql), [&]() {
+          return cnx.trans->exec(static_cast<std::string>(sql));
+      })) {}
+
+    /// Streaming recordsets
+    impl(std::unique_ptr<cursor> c) : impl(single(c->fetch()), c->binary) {
+        stream = std::move(c);
+    }
+    impl(std::unique_ptr<keyset> k) : impl(single(k->fetch())) {
+        stream = std::move(k);
+    }
+
+    static std::vector<pqxx::result> single(pqxx::result &&recs) {
+        std::vector<pqxx::result> p;
+        p.push_back(std::move(recs));
+        return p;
+    }
+
+    const pqxx::result &page(std::size_t number) const {
+        if (number < first_page) {
+            throw exceptions::not_implemented(
+                    __FUNCTION__,
+                    "Streamed recordsets can only be iterated once, and this "
+                    "page has already been discarded");
+        }
+        return pages[number - first_page];
+    }
+    /// Returns true if the page is available, fetching it from the cursor
+    /// if needed
+    bool has_page(std::size_t number) {
+        if (number < first_page + pages.size()) {
+            return true;
+        } else if (stream && stream->open) {
+            auto next = stream->fetch();
+            if (next.empty()) { return false; }
+            first_page += pages.size();
+            pages.clear();
+            pages.push_back(std::move(next));
+            return true;
+        } else {
+            return false;
+        }
+    }
+};
+
+
+struct fostlib::pg::record::source {
+    pqxx::row row;
+    std::shared_ptr<const column_layout> layout;
+
+    source(const pqxx::row &r, std::shared_ptr<const column_layout> l)
+    : row(r), layout(std::move(l)) {}
 };
 
 
 struct fostlib::pg::recordset::const_iterator::impl {
     fostlib::pg::recordset::impl *rs;
+    std::size_t page;
     pqxx::result::const_iterator position;
+    /// True when there are no more rows, or this is the end iterator
+    bool done;
+    /// False when the row is read by typed access rather than the record
+    bool records = true;
     record row;
 
     impl(pqxx::result::const_iterator pos, std::size_t cols)
-    : rs(nullptr), position(pos), row(cols) {}
+    : rs(nullptr), page(0), position(pos), done(true), row(cols) {}
     impl(fostlib::pg::recordset::impl *rs,
+         std::size_t page,
          pqxx::result::const_iterator pos,
+         bool done,
          std::size_t cols)
-    : rs(rs), position(pos), row(cols) {}
+    : rs(rs), page(page), position(pos), done(done), row(cols) {}
+
+    /// Move past the end of empty pages until we find a row or there are
+    /// no more pages
+    void skip_empty() {
+        while (position == rs->page(page).end() && rs->has_page(page + 1)) {
+            position = rs->page(++page).begin();
+        }
+        done = position == rs->page(page).end();
+    }
+
+    /// Point the record at the current row. Fields are decoded as they
+    /// are accessed
+    void load() {
+        if (row.src && row.src.use_count() == 1) {
+            row.src->row = *position;
+        } else {
+            /// The record's source is shared with a copy, so it mustn't
+            /// change under the copy
+            row.src = std::make_shared<record::source>(*position, rs->layout);
+        }
+        std::fill(row.decoded.begin(), row.decoded.end(), false);
+    }
 };
@@ -0,0 +1,215 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#include <fost/pg/connection.hpp>
+#include <fost/pg/recordset.hpp>
+#include <fost/pg/router.hpp>
+
+#include <fost/insert>
+#include <fost/log>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <numeric>
+
+
+namespace {
+
+
+    using clock_type = std::chrono::steady_clock;
+
+
+    /// Hot standbys can't run serializable transactions
+    fostlib::json replica_configuration(fostlib::json conf) {
+        if (not conf.has_key("transaction")) {
+            fostlib::insert(
+                    conf, "transaction", "isolation", "repeatable read");
+            fostlib::insert(conf, "transaction", "read_only", true);
+        }
+        return conf;
+    }
+
+    /// Reads that fall back to the primary must not be able to write
+    fostlib::json read_only_configuration(fostlib::json conf) {
+        if (conf.has_key("transaction")
+            && conf["transaction"].has_key("read_only")) {
+            fostlib::jcursor("transaction", "read_only")
+                    .replace(conf, fostlib::json(true));
+        } else {
+            fostlib::insert(conf, "transaction", "read_only", true);
+        }
+        return conf;
+    }
+
+
+}
+
+
+struct fostlib::pg::router::impl {
+    pool primary;
+    /// Used for reads when no replica is usable
+    pool primary_reader;
+
+    struct replica {
+        const json configuration;
+        pool connections;
+
+        std::mutex mutex;
+        /// When the lag was last measured, if it ever has been
+        std::optional<clock_type::time_point> checked;
+        double lag = 0;
+        int64_t reads = 0, stale = 0, failures = 0;
+
+        replica(const json &conf)
+        : configuration(replica_configuration(conf)),
+          connections(configuration) {}
+    };
+    std::vector<std::unique_ptr<replica>> replicas;
+
+    const bool least_loaded;
+    const std::optional<double> max_lag;
+    const clock_type::duration lag_check;
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<int64_t> primary_reads{0};
+
+    impl(const json &conf)
+    : primary(conf["primary"]),
+      primary_reader(read_only_configuration(conf["primary"])),
+      least_loaded(
+              conf.has_key("routing")
+              && coerce<string>(conf["routing"]) == "least loaded"),
+      max_lag(conf.has_key("max_lag")
+                      ? std::make_optional(coerce<double>(conf["max_lag"]))
+                      : std::nullopt),
+      lag_check(std::chrono::duration_cast<clock_type::duration>(
+              std::chrono::duration<double>(
+                      conf.has_key("lag_check")
+                              ? coerce<double>(conf["lag_check"])
+                              : 1.0))) {
+        for (const auto &r : conf["replicas"]) {
+            replicas.push_back(std::make_unique<replica>(r));
+        }
+    }
+
+    /// The order in which to try the replicas
+    std::vector<std::size_t> candidates() {
+        std::vector<std::size_t> order(replicas.size());
+        std::iota(order.begin(), order.end(), 0u);
+        if (least_loaded) {
+            std::vector<std::size_t> load(replicas.size());
+            for (std::size_t index{}; index != replicas.size(); ++index) {
+                load[index] = replicas[index]->connections.leased();
+            }
+            std::stable_sort(
+                    order.begin(), order.end(),
+                    [&load](auto a, auto b) { return load[a] < load[b]; });
+        } else if (not order.empty()) {
+            std::rotate(
+                    order.begin(), order.begin() + next++ % order.size(),
+                    order.end());
+        }
+        return order;
+    }
+
+    /// Check the replica is close enough behind the primary, measuring
+    /// the lag on the leased connection if it is due
+    bool fresh(replica &r, pool::lease &cnx) {
+        if (not max_lag) { return true; }
+        const auto now = clock_type::now();
+        {
+            std::lock_guard<std::mutex> lock{r.mutex};
+            if (r.checked && now - *r.checked < lag_check) {
+                return r.lag <= *max_lag;
+            }
+        }
+        auto rs = cnx->exec(
+                "SELECT extract(epoch FROM now() - "
+                "pg_last_xact_replay_timestamp())::float8");
+        const auto measured = (*rs.begin())[0];
+        /// Start a new transaction for the caller
+        cnx->rollback();
+        const double lag = measured.isnull() ? 0.0 : coerce<double>(measured);
+        std::lock_guard<std::mutex> lock{r.mutex};
+        r.checked = now;
+        r.lag = lag;
+        return lag <= *max_lag;
+    }
+};
+
+
+fostlib::pg::router::router(const json &conf)
+: pimpl(std::make_shared<impl>(conf)) {}
+
+
+fostlib::pg::pool::lease fostlib::pg::router::writer() {
+    return pimpl->primary.acquire();
+}
+
+
+fostlib::pg::pool::lease fostlib::pg::router::reader() {
+    for (const auto index : pimpl->candidates()) {
+        auto &r = *pimpl->replicas[index];
+        try {
+            auto cnx = r.connections.acquire();
+            if (pimpl->fresh(r, cnx)) {
+                std::lock_guard<std::mutex> lock{r.mutex};
+                ++r.reads;
+                return cnx;
+            } else {
+                std::lock_guard<std::mutex> lock{r.mutex};
+                ++r.stale;
+            }
+        } catch (std::exception &e) {
+            fostlib::log::warning(c_fost_pg)("", "Replica can't be used")(
+                    "replica", int64_t(index))("exception", "what", e.what())(
+                    "exception", "type", typeid(e).name());
+            std::lock_guard<std::mutex> lock{r.mutex};
+            ++r.failures;
+        }
+    }
+    ++pimpl->primary_reads;
+    return pimpl->primary_reader.acquire();
+}
+
+
+fostlib::pg::recordset
+        fostlib::pg::router::select(const char *relation, const json &keys) {
+    return reader()->select(relation, keys);
+}
+fostlib::pg::recordset fostlib::pg::router::select(
+        const char *relation, const json &keys, const json &order) {
+    return reader()->select(relation, keys, order);
+}
+fostlib::pg::recordset fostlib::pg::router::exec(const utf8_string &sql) {
+    return reader()->exec(sql);
+}
+
+
+fostlib::json fostlib::pg::router::statistics() const {
+    json stats;
+    insert(stats, "primary", "reads", pimpl->primary_reads.load());
+    insert(stats, "primary", "pool", pimpl->primary.statistics());
+    insert(stats, "primary", "reader", pimpl->primary_reader.statistics());
+    insert(stats, "replicas", json::array_t());
+    for (const auto &r : pimpl->replicas) {
+        json replica;
+        {
+            std::lock_guard<std::mutex> lock{r->mutex};
+            insert(replica, "reads", r->reads);
+            insert(replica, "stale", r->stale);
+            insert(replica, "failures", r->failures);
+            if (r->checked) { insert(replica, "lag", r->lag); }
+        }
+        insert(replica, "pool", r->connections.statistics());
+        jcursor("replicas").push_back(stats, replica);
+    }
+    return stats;
+}
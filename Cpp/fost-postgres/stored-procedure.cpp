@@ -10,21 +10,6 @@
 #include <fost/pg/stored-procedure.hpp>
 #include "connection.hpp"
 #include "recordset.hpp"
-#include <pqxx/prepared_statement>
-
-
-namespace {
-    template<typename Coll, typename Func>
-    auto exec_prepared(
-            pqxx::transaction<pqxx::serializable> &trans,
-            std::string const &name,
-            Coll &collection,
-            Func transform) {
-        return trans.exec_prepared(
-                name,
-                pqxx::prepare::make_dynamic_params(collection, transform));
-    }
-}
 
 
 fostlib::pg::unbound_procedure::unbound_procedure(
@@ -34,9 +19,14 @@ fostlib::pg::unbound_procedure::unbound_procedure(
 
 fostlib::pg::recordset fostlib::pg::unbound_procedure::exec(
         std::vector<fostlib::string> args) {
-    return recordset(std::make_unique<recordset::impl>(exec_prepared(
-            *cnx.pimpl->trans, name, args,
-            [](fostlib::string &arg) { return arg.shrink_to_fit(); })));
+    auto &pimpl = *cnx.pimpl;
+    return recordset(std::make_unique<recordset::impl>(
+            pimpl.measured(pimpl.procedures[name], [&]() {
+                return pimpl.exec_prepared(
+                        name, args, [](fostlib::string &arg) {
+                            return arg.shrink_to_fit();
+                        });
+            })));
 }
 
 
@@ -53,8 +43,36 @@ fostlib::pg::recordset fostlib::pg::unbound_procedure::exec(
                             fostlib::coerce<fostlib::string>(arg));
                 }
             });
+    auto &pimpl = *cnx.pimpl;
     return recordset(std::make_unique<recordset::impl>(
-            exec_prepared(*cnx.pimpl->trans, name, args, [](auto &arg) {
-                return arg.has_value() ? arg.value().c_str() : nullptr;
+            pimpl.measured(pimpl.procedures[name], [&]() {
+                return pimpl.exec_prepared(name, args, [](auto &arg) {
+                    return arg.has_value() ? arg.value().c_str() : nullptr;
+                });
             })));
 }
+
+
+fostlib::pg::recordset fostlib::pg::unbound_procedure::cached(
+        const std::vector<fostlib::json> &jsargs) {
+    auto &pimpl = *cnx.pimpl;
+    /// The procedure may read any of the relations written to in this
+    /// transaction, and results stored by other connections can't include
+    /// those writes
+    if (not pimpl.cache || not pimpl.written.empty()) { return exec(jsargs); }
+    fostlib::json arguments;
+    for (const auto &arg : jsargs) {
+        fostlib::jcursor().push_back(arguments, arg);
+    }
+    const std::string key = "procedure " + pimpl.procedures[name] + "\n"
+            + static_cast<std::string>(
+                    fostlib::json::unparse(arguments, false));
+    if (auto found = pimpl.cache->find(key); found) {
+        return recordset(std::make_unique<recordset::impl>(std::move(*found)));
+    }
+    const auto ticket = pimpl.cache_ticket();
+    auto results = exec(jsargs);
+    pimpl.cache->store(
+            key, std::string{}, ticket, results.pimpl->pages.front());
+    return results;
+}
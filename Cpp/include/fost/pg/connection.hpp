@@ -11,6 +11,11 @@
 
 #include <fost/core>
 
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <string_view>
+
 
 namespace fostlib {
 
@@ -21,18 +26,49 @@ namespace fostlib {
         extern const module c_fost_pg;
 
 
+        class connection_reference;
+        class copy_writer;
+        enum class copy_format;
+        class pending;
+        class pipeline;
         class recordset;
         class unbound_procedure;
 
 
+        /// The format the server sends result fields in. The binary format
+        /// avoids the server formatting, and us parsing, numbers and time
+        /// stamps as text.
+        enum class result_format { text, binary };
+
+
+        /// How `connection::transact` retries transactions that fail
+        /// because of concurrent transactions
+        struct retry_policy {
+            /// The most times the function is run, including the first
+            std::size_t attempts = 5;
+            /// The backoff doubles after each retry up to the maximum. The
+            /// actual delay is a random time up to the backoff
+            std::chrono::milliseconds backoff{10}, max_backoff{1000};
+        };
+
+
         /// A read/write database connection. Also provides a low level API
         /// for interacting with the database.
         class connection {
+            friend class connection_reference;
+            friend class copy_writer;
+            friend class pending;
+            friend class pipeline;
             friend class recordset;
             friend class unbound_procedure;
             struct impl;
             std::unique_ptr<impl> pimpl;
 
+            /// Execute generated SQL through the prepared statement cache
+            recordset exec_cached(
+                    const string &sql,
+                    const std::vector<std::optional<std::string>> &args);
+
           public:
             /// A default connection without host or password
             connection();
@@ -46,6 +82,26 @@ namespace fostlib {
             /// 2. host -- The host (or path when starting with /)
             /// 3. password -- Connection password to use
             /// 4. user -- The username
+            /// 5. transaction -- An object describing the transactions the
+            /// commands are run in:
+            ///    * isolation -- "serializable" (the default),
+            ///      "repeatable read", "read committed", or "none" to run
+            ///      each command on its own without a transaction
+            ///    * read_only -- true for read only transactions
+            ///    * deferrable -- true for deferrable transactions, which
+            ///      only has an effect on serializable read only ones
+            /// 6. cache -- Turns on the result cache for `select` and
+            /// `unbound_procedure::cached`. Either true, or an object with:
+            ///    * ttl -- Seconds results are kept for (default 60)
+            ///    * bytes -- The most memory the results may use (default
+            ///      16MB)
+            ///    The cache is shared by all connections with the same
+            ///    configuration. Writes made by `insert`, `update`,
+            ///    `upsert` and `copy_in` invalidate the results for the
+            ///    relation, which must be named the same way in the
+            ///    `select`. Any other writes need an explicit `invalidate`.
+            ///    Once a transaction has written to a relation its
+            ///    `select`s from it skip the cache until it ends.
             connection(const json &);
 
             /// Move constructor
@@ -57,8 +113,51 @@ namespace fostlib {
             /// Retrieve the connection configuration details
             const json &configuration() const;
 
-            /// Commit the transaction
+            /// Counters describing the use of the connection. The
+            /// generated SQL for `select`, `insert`, `update` and `upsert`
+            /// is prepared once for each shape of call and cached (up to
+            /// the "Prepared statement cache size" setting in the
+            /// "Postgres" section), with the cache use reported under
+            /// `statements`. When the result cache is used its figures are
+            /// under `cache`. When the "Query metrics" setting is turned
+            /// on (it is off by default) the latency, rows and bytes for
+            /// the commands run are reported under `queries`, both in total
+            /// and for each SQL statement. The latency histograms count
+            /// the commands taking no longer than each of the bounds
+            /// listed in `queries.histogram`, with a final bucket for the
+            /// slower ones. Commands taking longer than the "Slow query
+            /// seconds" setting are logged as warnings whether or not the
+            /// metrics are on.
+            json statistics() const;
+            /// The `queries` figures for all connections in the process.
+            /// When the "Time field decoding" setting is on this also
+            /// includes the time spent decoding fields.
+            static json process_statistics();
+
+            /// Drop the results for the relation from the result cache
+            connection &invalidate(const char *relation);
+            /// Drop all of the results from the result cache
+            connection &invalidate();
+
+            /// Commit the transaction and start a new one of the same kind.
+            /// Throws `std::logic_error` if the results of commands sent by
+            /// `exec_async` haven't all been read
             void commit();
+            /// Abandon the current transaction and start a new one. The
+            /// results of any outstanding asynchronous commands are thrown
+            /// away
+            void rollback();
+            /// Run the function in a fresh transaction and commit it when
+            /// the function returns. Anything not yet committed on the
+            /// connection is rolled back first. If the transaction fails
+            /// because of a serialization failure or deadlock (SQLSTATE
+            /// 40001 or 40P01) then it is rolled back and the function run
+            /// again after a backoff. Any other error rolls back the
+            /// transaction and is rethrown. Retries are logged to
+            /// `c_fost_pg`.
+            void transact(
+                    const std::function<void(connection &)> &,
+                    const retry_policy & = retry_policy{});
 
             /// Configuration options
             connection &zoneinfo(const fostlib::string &zi);
@@ -68,11 +167,91 @@ namespace fostlib {
 
             /// Return a recordset range from the execution of the command
             recordset exec(const utf8_string &);
+            /// Execute a query returning its results in the requested
+            /// format. Binary results are fetched through a server side
+            /// cursor, so the command must be a query that can be used for
+            /// a cursor. The JSON is always the same as for the text
+            /// format, so the columns are looked at first, without running
+            /// the query, and if any can't be decoded that way from the
+            /// binary format the query is run in the text format instead.
+            /// That happens for types without a binary decoder, and for
+            /// time and `bytea` columns when the session isn't using UTC,
+            /// the ISO date style and hex `bytea` output. The query is run
+            /// only once either way, but finding the columns costs an
+            /// extra round trip. Binary recordsets are read through their
+            /// records.
+            recordset exec(const utf8_string &, result_format);
+            /// Send the command to the server without waiting for its
+            /// results. The command is run within the connection's
+            /// transaction
+            pending exec_async(const utf8_string &);
+            /// The connection's socket, for waiting on in an event loop
+            /// whilst there are `pending` results
+            int socket() const;
+
+            /// Return a recordset that reads the results of the query
+            /// through a server side cursor, `batch_rows` at a time, so
+            /// only one batch is held in memory. The recordset can only be
+            /// iterated once, and only until the transaction is committed
+            /// or rolled back. Reading more rows after the connection has
+            /// been destroyed throws. A binary stream is read in the text
+            /// format instead in the same cases as for `exec`.
+            recordset
+                    stream(const utf8_string &,
+                           std::size_t batch_rows = 1000,
+                           result_format = result_format::text);
             /// Select statement intended for fetching individual row, or
             /// collections
             recordset select(const char *relation, const json &keys);
             recordset select(
                     const char *relation, const json &keys, const json &order);
+            /// Iterate over all of the rows in the relation that match the
+            /// keys, `page_size` rows at a time, using keyset pagination.
+            /// Each page is a separate query for the rows after the last
+            /// row of the page before, so no server side state is kept
+            /// between pages. The `order` columns must be NOT NULL and
+            /// together unique, and are given as plain column names. The
+            /// select list is `*` unless `columns` is given, in which case
+            /// any missing `order` columns are added to the end of it. The
+            /// recordset can only be iterated once, and not after the
+            /// connection has been destroyed.
+            recordset
+                    scan(const char *relation,
+                         const json &keys,
+                         const std::vector<fostlib::string> &order,
+                         std::size_t page_size = 1000,
+                         const std::vector<fostlib::string> &columns = {});
+            /// Fetch the rows for many keys in one statement rather than
+            /// one `select` for each. With a single key column each key
+            /// may be the value itself, otherwise each key is an object
+            /// with a value for every one of the `key_columns`. The keys
+            /// are sent as array parameters, matched with `= ANY` for a
+            /// single column and `unnest` for several, in chunks of no
+            /// more than the "Maximum keys in a select" setting. Rows come
+            /// back in no particular order and always include the key
+            /// columns, which are added to the end of `columns` if they
+            /// are missing, so that they can be matched to the keys.
+            /// Duplicate keys and keys with a null are skipped.
+            recordset select_many(
+                    const char *relation,
+                    const std::vector<fostlib::string> &key_columns,
+                    const std::vector<json> &keys,
+                    const std::vector<fostlib::string> &columns = {});
+            /// Read a `bytea` value in chunks of no more than `chunk_bytes`,
+            /// passing each to the function as it arrives so that the
+            /// whole value is never held in memory. The row is found by
+            /// its keys in the same way as for `select`, and if they match
+            /// more than one row this throws. Each chunk is fetched using
+            /// `substring`, so the column's storage should be `EXTERNAL`
+            /// (uncompressed) for the server to be able to read just that
+            /// slice. Returns the number of bytes read, which is zero if
+            /// there is no row or the value is NULL.
+            std::size_t read_bytes(
+                    const char *relation,
+                    const char *column,
+                    const json &keys,
+                    const std::function<void(std::string_view)> &chunk,
+                    std::size_t chunk_bytes = 1 << 20);
             /// Perform a one row INSERT statement. Pass a JSON object that
             /// specifies the field names and values
             connection &insert(const char *relation, const json &values);
@@ -81,6 +260,18 @@ namespace fostlib {
                     insert(const char *relation,
                            const json &values,
                            const std::vector<fostlib::string> &returning);
+            /// Insert many rows. Consecutive rows with the same columns are
+            /// sent together using multi-row INSERT statements, chunked to
+            /// stay within the "Maximum rows in a batch" setting and the
+            /// protocol's parameter limit
+            connection &
+                    insert(const char *relation, const std::vector<json> &rows);
+            /// Insert many rows, returning a single recordset across all
+            /// of the statements executed
+            recordset
+                    insert(const char *relation,
+                           const std::vector<json> &rows,
+                           const std::vector<fostlib::string> &returning);
             /// Perform a one row UPDATE statement. Give the keys and values
             connection &update(
                     const char *relation, const json &keys, const json &values);
@@ -99,6 +290,48 @@ namespace fostlib {
                            const json &values,
                            const std::vector<fostlib::string> &returning);
 
+            /// UPSERT many rows, batched in the same way as the multi-row
+            /// `insert`. Each row contains both the key and value columns,
+            /// with `keys` naming the columns for the ON CONFLICT clause.
+            /// A key may only appear once within any batch.
+            connection &
+                    upsert(const char *relation,
+                           const std::vector<fostlib::string> &keys,
+                           const std::vector<json> &rows);
+            recordset
+                    upsert(const char *relation,
+                           const std::vector<fostlib::string> &keys,
+                           const std::vector<json> &rows,
+                           const std::vector<fostlib::string> &returning);
+
+            /// Start a bulk load of rows into the relation for the given
+            /// columns using `COPY ... FROM STDIN`. Buffered rows are sent
+            /// whenever the buffer exceeds `flush_bytes`
+            copy_writer
+                    copy_in(const char *relation,
+                            std::vector<fostlib::string> columns,
+                            std::size_t flush_bytes = 64 << 10);
+            /// Stream the results of the query out using `COPY ... TO
+            /// STDOUT`. The rows are passed to the sink as they arrive, in
+            /// chunks of about `flush_bytes`, without being decoded, so
+            /// only one chunk is held in memory. Returns the number of
+            /// rows.
+            std::size_t copy_out(
+                    const utf8_string &query,
+                    const std::function<void(std::string_view)> &sink,
+                    copy_format,
+                    std::size_t flush_bytes = 64 << 10);
+            /// Stream the results of the query to the stream
+            std::size_t copy_out(
+                    const utf8_string &query, std::ostream &, copy_format);
+            /// Stream the results of the query to the file descriptor
+            std::size_t
+                    copy_out(const utf8_string &query, int fd, copy_format);
+
+            /// Start queueing independent commands so they can be sent to
+            /// the server together
+            pipeline queue();
+
             /// Create an anonymous stored procedure
             unbound_procedure procedure(const utf8_string &);
         };
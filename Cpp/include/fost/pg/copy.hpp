@@ -0,0 +1,115 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+
+#include <optional>
+#include <string_view>
+#include <tuple>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        class connection;
+
+
+        /// The formats `connection::copy_out` can write
+        enum class copy_format {
+            /// The COPY text format, tab separated with backslash escapes
+            /// and `\N` for NULL
+            text,
+            /// Comma separated with double quotes where needed, and NULL
+            /// as an empty unquoted field
+            csv
+        };
+
+
+        /// Streams rows into a table using `COPY ... FROM STDIN`. Rows are
+        /// encoded in the COPY text format into a buffer which is sent to
+        /// the server whenever it grows beyond the flush size. No other
+        /// commands can be run on the connection until the copy has been
+        /// completed.
+        class copy_writer {
+            friend class connection;
+            struct impl;
+            std::unique_ptr<impl> pimpl;
+
+            copy_writer(
+                    connection &,
+                    const char *relation,
+                    std::vector<fostlib::string> columns,
+                    std::size_t flush_bytes);
+
+            void field(std::nullopt_t);
+            void field(const json &);
+            void field(bool);
+            void field(int64_t);
+            void field(double);
+            void field(std::string_view);
+            void field(const char *s) { field(std::string_view{s}); }
+            void field(const std::string &s) { field(std::string_view{s}); }
+            void field(const fostlib::string &s) {
+                field(static_cast<std::string>(s));
+            }
+            template<typename T>
+            auto field(T v) -> std::enable_if_t<std::is_integral_v<T>> {
+                field(int64_t(v));
+            }
+            template<typename T>
+            void field(const std::optional<T> &v) {
+                if (v) {
+                    field(*v);
+                } else {
+                    field(std::nullopt);
+                }
+            }
+            void end_row();
+
+          public:
+            /// Allow move
+            copy_writer(copy_writer &&);
+            /// Completes the copy if that hasn't already been done. If the
+            /// writer is destroyed because an exception is being thrown
+            /// the copy is abandoned instead, and none of its rows are
+            /// written. Using the writer after its connection has been
+            /// destroyed throws.
+            ~copy_writer();
+
+            /// Write a row given either as an array of values in column
+            /// order, or as an object keyed by column name. Columns missing
+            /// from an object are written as NULL.
+            copy_writer &row(const json &);
+            /// Write a row given as a tuple of values in column order
+            template<typename... Ts>
+            copy_writer &row(const std::tuple<Ts...> &values) {
+                std::apply(
+                        [this](const auto &... v) { (field(v), ...); },
+                        values);
+                end_row();
+                return *this;
+            }
+
+            /// Send any buffered rows to the server
+            copy_writer &flush();
+            /// Send the remaining rows and finish the copy. Returns the
+            /// number of rows written.
+            std::size_t complete();
+        };
+
+
+    }
+
+
+}
@@ -0,0 +1,185 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+#include <fost/exception/null.hpp>
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// Decoders turn the text of a field directly into a native type.
+        /// Each specialization says which column type OIDs it can be used
+        /// for and decodes the field's text.
+        template<typename T>
+        struct decoder;
+
+        template<>
+        struct decoder<bool> {
+            static bool accepts(unsigned int oid);
+            static bool decode(unsigned int oid, std::string_view);
+        };
+        template<>
+        struct decoder<int16_t> {
+            static bool accepts(unsigned int oid);
+            static int16_t decode(unsigned int oid, std::string_view);
+        };
+        template<>
+        struct decoder<int32_t> {
+            static bool accepts(unsigned int oid);
+            static int32_t decode(unsigned int oid, std::string_view);
+        };
+        template<>
+        struct decoder<int64_t> {
+            static bool accepts(unsigned int oid);
+            static int64_t decode(unsigned int oid, std::string_view);
+        };
+        template<>
+        struct decoder<double> {
+            static bool accepts(unsigned int oid);
+            static double decode(unsigned int oid, std::string_view);
+        };
+        /// Any column can be read as text. For `std::string_view` the
+        /// text is only valid until the result holding it is released
+        template<>
+        struct decoder<std::string_view> {
+            static bool accepts(unsigned int) { return true; }
+            static std::string_view decode(unsigned int, std::string_view s) {
+                return s;
+            }
+        };
+        template<>
+        struct decoder<std::string> {
+            static bool accepts(unsigned int) { return true; }
+            static std::string decode(unsigned int, std::string_view s) {
+                return std::string(s);
+            }
+        };
+        template<>
+        struct decoder<fostlib::string> {
+            static bool accepts(unsigned int) { return true; }
+            static fostlib::string decode(unsigned int, std::string_view s) {
+                return fostlib::string(std::string(s));
+            }
+        };
+        /// Decodes the same way as for the fields in a `record`
+        template<>
+        struct decoder<json> {
+            /// Decodes the fields of a column. Recordsets look the function
+            /// up once for each column rather than for every field
+            using function = json (*)(unsigned int oid, std::string_view);
+            static function plan(unsigned int oid);
+            static function plan_binary(unsigned int oid);
+            /// True if there is a decoder for the binary format of the type
+            static bool accepts_binary(unsigned int oid);
+
+            static bool accepts(unsigned int oid);
+            /// False if fields of the type are only passed on as their
+            /// text because there is no decoder for it
+            static bool known(unsigned int oid);
+            static json decode(unsigned int oid, std::string_view);
+            /// Decode a field sent in the binary format. The JSON produced
+            /// is the same as for the text format, except that time stamps
+            /// are always given in UTC
+            static json decode_binary(unsigned int oid, std::string_view);
+        };
+        /// The unparsed text of a `json` or `jsonb` field, for when it is
+        /// only going to be passed on. Like `std::string_view` the text is
+        /// only valid until the result holding it is released
+        struct raw_json {
+            std::string_view text;
+        };
+        template<>
+        struct decoder<raw_json> {
+            static bool accepts(unsigned int oid) {
+                return oid == 114 || oid == 3802;
+            }
+            static raw_json decode(unsigned int, std::string_view s) {
+                return {s};
+            }
+        };
+        /// The bytes held in a `bytea` field. The text format sends them
+        /// hex encoded (or in the older escape format), so they have to be
+        /// decoded into a buffer
+        template<>
+        struct decoder<std::vector<unsigned char>> {
+            static bool accepts(unsigned int oid) { return oid == 17; }
+            static std::vector<unsigned char>
+                    decode(unsigned int oid, std::string_view);
+        };
+        /// Decode the text format of a `bytea` field, appending the bytes
+        /// to the buffer
+        void bytea_from_text(std::string_view, std::vector<unsigned char> &);
+        /// Reads `timestamp with time zone` columns. The server must be
+        /// using the ISO date style (the default). `infinity` and
+        /// `-infinity` become the latest and earliest time points, and
+        /// times that `system_clock` can't represent throw a
+        /// `parse_error`.
+        template<>
+        struct decoder<std::chrono::system_clock::time_point> {
+            static bool accepts(unsigned int oid);
+            static std::chrono::system_clock::time_point
+                    decode(unsigned int oid, std::string_view);
+        };
+
+
+        namespace detail {
+
+
+            /// Deals with NULL before handing over to the type's decoder.
+            /// Only `std::optional` types can be used to read NULL.
+            template<typename T>
+            struct field_decoder {
+                static bool accepts(unsigned int oid) {
+                    return decoder<T>::accepts(oid);
+                }
+                static T decode(
+                        unsigned int oid, std::optional<std::string_view> s) {
+                    if (s) {
+                        return decoder<T>::decode(oid, *s);
+                    } else {
+                        throw exceptions::null(
+                                "A NULL value can only be read into a "
+                                "std::optional");
+                    }
+                }
+            };
+            template<typename T>
+            struct field_decoder<std::optional<T>> {
+                static bool accepts(unsigned int oid) {
+                    return decoder<T>::accepts(oid);
+                }
+                static std::optional<T> decode(
+                        unsigned int oid, std::optional<std::string_view> s) {
+                    if (s) {
+                        return decoder<T>::decode(oid, *s);
+                    } else {
+                        return {};
+                    }
+                }
+            };
+
+
+        }
+
+
+    }
+
+
+}
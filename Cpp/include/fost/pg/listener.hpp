@@ -0,0 +1,83 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+
+#include <chrono>
+#include <functional>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// Receives the notifications sent with `NOTIFY` or `pg_notify` on
+        /// channels it listens to. The listener has its own connection to
+        /// the database, made from the same JSON configuration as for a
+        /// `connection`, which is kept outside of a transaction so that
+        /// notifications are delivered as soon as they are committed.
+        ///
+        /// Nothing is read from the server except in `wait` and `dispatch`,
+        /// and neither of these sends any commands. To use the listener
+        /// from an event loop add its `socket` for reading and call
+        /// `dispatch` whenever it is readable.
+        class listener {
+            struct impl;
+            std::unique_ptr<impl> pimpl;
+
+          public:
+            struct notification {
+                string channel;
+                string payload;
+                /// The process ID of the server backend that sent it
+                int backend_pid;
+            };
+            using callback = std::function<void(const notification &)>;
+
+            /// A listener for the default database
+            listener();
+            /// Connect using the provided JSON configuration
+            listener(const json &configuration);
+
+            /// Allow move
+            listener(listener &&);
+            ~listener();
+
+            /// Call the callback for each notification on the channel. A
+            /// channel may have several callbacks, which are called in the
+            /// order they were added. `LISTEN` is only sent for the first.
+            /// Callbacks may themselves call `listen` and `unlisten`.
+            listener &listen(const string &channel, callback);
+            /// Stop listening on the channel and drop its callbacks. When
+            /// called from a callback the rest of the channel's callbacks
+            /// aren't called
+            listener &unlisten(const string &channel);
+
+            /// The socket for the connection. It becomes readable when
+            /// notifications arrive.
+            int socket() const;
+
+            /// Dispatch the notifications that have already arrived without
+            /// waiting. Returns the number dispatched.
+            std::size_t dispatch();
+            /// Wait for notifications to arrive, for no longer than the
+            /// timeout, and dispatch them. Returns the number dispatched,
+            /// which is zero if the timeout expired.
+            std::size_t wait(std::chrono::milliseconds timeout);
+        };
+
+
+    }
+
+
+}
@@ -0,0 +1,62 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        class connection;
+        class recordset;
+        class unbound_procedure;
+
+
+        /// A command that has been sent to the server but whose results
+        /// haven't been read yet. Commands sent on the same connection run
+        /// in the order they were sent. Until all of the pending results
+        /// have been read the connection can only be used to send further
+        /// asynchronous commands, and the transaction can't be committed.
+        /// Once the connection has been destroyed `ready` and `get` throw.
+        /// If the transaction is rolled back first the results are lost,
+        /// `ready` returns true and `get` throws.
+        class pending {
+            friend class connection;
+            friend class unbound_procedure;
+            struct impl;
+            std::unique_ptr<impl> pimpl;
+
+            pending(connection &, const std::string &sql);
+
+          public:
+            /// Allow move
+            pending(pending &&);
+            /// Waits for and discards the results if they haven't been read
+            ~pending();
+
+            /// Reads whatever has arrived from the server without blocking,
+            /// and returns true once the results are available, so that
+            /// `get` will not wait. Use with `connection::socket` to drive
+            /// connections from an event loop.
+            bool ready();
+            /// Return the results, waiting for them if necessary. Can only
+            /// be called once.
+            recordset get();
+        };
+
+
+    }
+
+
+}
@@ -0,0 +1,91 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/core>
+
+#include <stdexcept>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        class connection;
+        class recordset;
+        class unbound_procedure;
+
+
+        /// Queues independent commands so that they can be sent to the
+        /// server together, paying for a single round trip rather than one
+        /// per command. The commands are run in order within the
+        /// connection's transaction. Nothing else should be run on the
+        /// connection between queueing commands and calling `sync`.
+        ///
+        /// The batch is sent as one simple query, which cannot carry bound
+        /// parameters. Values given to `select` and to procedures are
+        /// therefore quoted and embedded in the SQL as literals. Quoting
+        /// makes this safe, but the server has to parse and plan each
+        /// `select` again and each value is sent in its text form. Where
+        /// that matters use the equivalent `connection` members instead.
+        class pipeline {
+            friend class connection;
+            struct impl;
+            std::unique_ptr<impl> pimpl;
+
+            pipeline(connection &);
+
+          public:
+            /// Thrown by `sync` for the first command that fails. The
+            /// commands after it are not run.
+            class failed : public std::runtime_error {
+              public:
+                failed(std::size_t statement,
+                       const std::string &sql,
+                       const char *what);
+
+                /// The position of the command, as returned when it was
+                /// queued
+                const std::size_t statement;
+                const std::string sql;
+            };
+
+            /// Allow move
+            pipeline(pipeline &&);
+            ~pipeline();
+
+            /// Queue a command. The return value is the position of its
+            /// recordset in the results of `sync`.
+            std::size_t exec(const utf8_string &);
+            /// Queue a `select` as for `connection::select`
+            std::size_t select(const char *relation, const json &keys);
+            std::size_t select(
+                    const char *relation, const json &keys, const json &order);
+            /// Queue an execution of the procedure
+            std::size_t
+                    exec(const unbound_procedure &,
+                         const std::vector<json> &args);
+
+            /// The number of commands waiting to be sent
+            std::size_t size() const;
+
+            /// Send the queued commands and return the recordset for each,
+            /// in the order they were queued. The pipeline can then be
+            /// used again.
+            std::vector<recordset> sync();
+        };
+
+
+    }
+
+
+}
@@ -0,0 +1,93 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/pg/connection.hpp>
+
+#include <stdexcept>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        /// A thread safe pool of database connections. All pools that are
+        /// constructed from configurations with the same effective
+        /// configuration (see `connection::configuration`) share the same
+        /// underlying set of connections.
+        ///
+        /// The pool is configured by a `pool` object inside the connection
+        /// configuration. Supported items are:
+        /// 1. min -- The number of connections kept open even when idle
+        ///     (default 0)
+        /// 2. max -- The maximum number of connections that may be open at
+        ///     once (default 10)
+        /// 3. idle -- Seconds an idle connection is kept before it is closed
+        ///     (default 60)
+        /// 4. wait -- Seconds to wait for a connection to become available
+        ///     before giving up (default 5)
+        /// A configuration without pool options uses the existing pool for
+        /// its effective configuration. One whose pool options differ from
+        /// the existing pool's throws.
+        class pool {
+            struct impl;
+            std::shared_ptr<impl> pimpl;
+
+          public:
+            /// Use (or create) the pool for this connection configuration
+            pool(const json &configuration);
+
+            /// Thrown when no connection becomes available in time
+            struct exhausted : public std::runtime_error {
+                exhausted();
+            };
+
+            /// A connection borrowed from the pool. When the lease goes out
+            /// of scope any uncommitted work is rolled back, the session's
+            /// settings, listens, cursors and temporary tables are reset,
+            /// and the connection is returned to the pool.
+            class lease {
+                friend class pool;
+                std::shared_ptr<pool::impl> owner;
+                std::unique_ptr<connection> cnx;
+
+                lease(std::shared_ptr<pool::impl>,
+                      std::unique_ptr<connection>);
+
+              public:
+                /// Leases can be moved, but not copied
+                lease(lease &&);
+                lease &operator=(lease &&);
+                /// Returns the connection to the pool
+                ~lease();
+
+                /// Access the leased connection
+                connection &operator*() const { return *cnx; }
+                connection *operator->() const { return cnx.get(); }
+            };
+
+            /// Borrow a connection from the pool. Throws `exhausted` if
+            /// a connection doesn't become available within the wait time
+            lease acquire();
+
+            /// The number of connections currently leased
+            std::size_t leased() const;
+
+            /// Counters describing the pool's use. Times are in seconds.
+            json statistics() const;
+        };
+
+
+    }
+
+
+}
@@ -11,6 +11,11 @@
 
 #include <fost/core>
 #include <fost/pg/connection.hpp>
+#include <fost/pg/decoder.hpp>
+
+#include <array>
+#include <tuple>
+#include <utility>
 
 
 namespace fostlib {
@@ -23,6 +28,31 @@ namespace fostlib {
         class unbound_procedure;
 
 
+        /// A column decoded into contiguous storage. NULL values are
+        /// default constructed in `values` and flagged in `nulls`.
+        template<typename T>
+        struct column_vector {
+            std::vector<T> values;
+            /// True for each row where the column is NULL
+            std::vector<bool> nulls;
+
+            void reserve(std::size_t rows) {
+                values.reserve(rows);
+                nulls.reserve(rows);
+            }
+            void push_back(
+                    unsigned int oid, std::optional<std::string_view> s) {
+                if (s) {
+                    values.push_back(decoder<T>::decode(oid, *s));
+                    nulls.push_back(false);
+                } else {
+                    values.emplace_back();
+                    nulls.push_back(true);
+                }
+            }
+        };
+
+
         /// A range-based recordset
         class recordset {
             friend class unbound_procedure;
@@ -33,21 +63,62 @@ namespace fostlib {
             recordset(std::unique_ptr<impl> &&p);
             recordset(connection::impl &, const utf8_string &);
 
+            /// Used by typed access
+            const std::vector<unsigned int> &column_types() const;
+            /// Typed access decodes text, so binary recordsets are refused
+            void check_text() const;
+            void check_columns(
+                    std::initializer_list<bool (*)(unsigned int)>) const;
+            void check_column(std::size_t, bool (*)(unsigned int)) const;
+            /// The number of rows currently held in memory
+            std::size_t size_hint() const;
+
+            template<typename... Ts, std::size_t... I>
+            std::tuple<column_vector<Ts>...> columnar(
+                    const std::array<std::size_t, sizeof...(Ts)> &indexes,
+                    std::index_sequence<I...>) const;
+
           public:
             /// Allow move
             recordset(recordset &&);
             /// Allow public desctruction
             ~recordset();
 
-            /// Return the column names
+            /// Return the column names. These are worked out once when the
+            /// recordset is created
             std::vector<fostlib::nullable<fostlib::string>> columns() const;
+            /// Return the position of the named column using a hash table
+            /// of the column names. Throws if there is no such column
+            std::size_t index_of(const fostlib::string &name) const;
+
+            /// Decode a whole column into a `column_vector`
+            template<typename T>
+            column_vector<T> column(std::size_t index) const {
+                return std::get<0>(columnar<T>({index}));
+            }
+            template<typename T>
+            column_vector<T> column(const fostlib::string &name) const {
+                return column<T>(index_of(name));
+            }
+            /// Decode several columns in a single pass over the rows
+            template<typename... Ts>
+            std::tuple<column_vector<Ts>...>
+                    columnar(const std::array<std::size_t, sizeof...(Ts)>
+                                     &indexes) const {
+                return columnar<Ts...>(
+                        indexes, std::index_sequence_for<Ts...>{});
+            }
 
             /// The recordset iterator
             class const_iterator :
             public std::iterator<std::input_iterator_tag, record> {
                 struct impl;
                 std::unique_ptr<impl> pimpl;
-                const_iterator(recordset::impl &, bool);
+                const_iterator(
+                        recordset::impl &, bool, bool records = true);
+
+                /// The text of the field in the current row, if not NULL
+                std::optional<std::string_view> text(std::size_t) const;
 
               public:
                 /// Default construct needs to be allowed
@@ -85,31 +156,193 @@ namespace fostlib {
             /// The end of the recordset
             const_iterator end() const;
 
+            /// A range over the rows that decodes each one directly into a
+            /// tuple of the requested types, without going through
+            /// `record`.
+            template<typename... Ts>
+            class typed {
+                friend class recordset;
+                const recordset &rs;
+                const std::vector<unsigned int> &types;
+
+                typed(const recordset &r) : rs(r), types(r.column_types()) {
+                    rs.check_columns(
+                            {&detail::field_decoder<Ts>::accepts...});
+                }
+
+              public:
+                class iterator {
+                    friend class typed;
+                    const std::vector<unsigned int> *types;
+                    const_iterator position;
+
+                    iterator(const std::vector<unsigned int> &t,
+                             const_iterator p)
+                    : types(&t), position(std::move(p)) {}
+
+                    template<std::size_t... I>
+                    std::tuple<Ts...> row(std::index_sequence<I...>) const {
+                        return std::tuple<Ts...>{
+                                detail::field_decoder<Ts>::decode(
+                                        (*types)[I], position.text(I))...};
+                    }
+
+                  public:
+                    using iterator_category = std::input_iterator_tag;
+                    using value_type = std::tuple<Ts...>;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = void;
+                    using reference = value_type;
+
+                    value_type operator*() const {
+                        return row(std::index_sequence_for<Ts...>{});
+                    }
+                    iterator &operator++() {
+                        ++position;
+                        return *this;
+                    }
+                    bool operator==(const iterator &i) const {
+                        return position == i.position;
+                    }
+                    bool operator!=(const iterator &i) const {
+                        return position != i.position;
+                    }
+                };
+
+                iterator begin() const {
+                    return iterator(
+                            types, const_iterator(*rs.pimpl, true, false));
+                }
+                iterator end() const {
+                    return iterator(
+                            types, const_iterator(*rs.pimpl, false, false));
+                }
+            };
+
+            /// Access the rows as tuples of native types, e.g.
+            /// `for (auto [id, name] : rs.as<int64_t, std::string>())`.
+            /// The column count and types are checked once when this is
+            /// called. Wrap a type in `std::optional` to allow NULL. The
+            /// range refers back to the recordset, so it isn't available
+            /// on a temporary recordset.
+            template<typename... Ts>
+            typed<Ts...> as() const & {
+                return typed<Ts...>(*this);
+            }
+            template<typename... Ts>
+            typed<Ts...> as() && = delete;
+
             friend class const_iterator;
             friend class connection;
+            friend class pending;
+            friend class pipeline;
         };
 
 
-        /// A single row in the results
+        template<typename... Ts, std::size_t... I>
+        inline std::tuple<column_vector<Ts>...> recordset::columnar(
+                const std::array<std::size_t, sizeof...(Ts)> &indexes,
+                std::index_sequence<I...>) const {
+            (check_column(indexes[I], &decoder<Ts>::accepts), ...);
+            std::tuple<column_vector<Ts>...> result;
+            const auto rows = size_hint();
+            (std::get<I>(result).reserve(rows), ...);
+            const auto &types = column_types();
+            const const_iterator end{*pimpl, false, false};
+            for (const_iterator pos{*pimpl, true, false}; pos != end; ++pos) {
+                (std::get<I>(result).push_back(
+                         types[indexes[I]], pos.text(indexes[I])),
+                 ...);
+            }
+            return result;
+        }
+
+
+        /// A single row in the results. The fields are decoded when they
+        /// are first accessed
         class record {
-            std::vector<json> fields;
+            struct source;
+            std::shared_ptr<source> src;
+            mutable std::vector<json> fields;
+            mutable std::vector<bool> decoded;
             record(std::size_t);
 
+            void decode(std::size_t) const;
+
           public:
             /// The number of columns
             std::size_t size() const { return fields.size(); }
 
             /// Return the value in the specified field number
             const json &operator[](std::size_t index) const {
+                if (not decoded[index]) { decode(index); }
                 return fields[index];
             }
+            /// Return the value in the named field. The names are those
+            /// given by `recordset::columns`, and are looked up in a table
+            /// built once for the recordset
+            const json &operator[](const string &name) const;
+            /// The field as sent by the server, without decoding it. This
+            /// allows `json` and `jsonb` fields to be forwarded without
+            /// being parsed. The view is valid until the recordset
+            /// iterator is moved on, or for as long as a copy of the record
+            /// is kept.
+            std::optional<std::string_view> raw(std::size_t index) const;
+            /// The bytes held in a `bytea` field, or nothing if the field
+            /// is NULL. In binary recordsets the field already holds the
+            /// bytes, so this is a view of it with the same lifetime as
+            /// for `raw` and the buffer isn't used. In text recordsets the
+            /// field holds the hex encoding, which is decoded into the
+            /// buffer. The view is then only valid until the buffer is
+            /// next changed. The buffer can be reused for each row to avoid
+            /// allocating. Throws `not_implemented` for fields of any other
+            /// type.
+            std::optional<std::string_view> bytes(
+                    std::size_t index,
+                    std::vector<unsigned char> &buffer) const;
 
             friend class recordset::const_iterator;
 
-            /// Use the vector iterator
-            using const_iterator = std::vector<json>::const_iterator;
-            const_iterator begin() const { return fields.begin(); }
-            const_iterator end() const { return fields.end(); }
+            /// Iterate over the fields, decoding them as they are reached
+            class const_iterator {
+                const record *rec;
+                std::size_t index;
+
+              public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = json;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const json *;
+                using reference = const json &;
+
+                const_iterator() : rec(nullptr), index(0) {}
+                const_iterator(const record *r, std::size_t i)
+                : rec(r), index(i) {}
+
+                reference operator*() const { return (*rec)[index]; }
+                pointer operator->() const { return &(*rec)[index]; }
+
+                const_iterator &operator++() {
+                    ++index;
+                    return *this;
+                }
+                const_iterator operator++(int) {
+                    auto result = *this;
+                    ++index;
+                    return result;
+                }
+
+                bool operator==(const const_iterator &ci) const {
+                    return rec == ci.rec && index == ci.index;
+                }
+                bool operator!=(const const_iterator &ci) const {
+                    return not(*this == ci);
+                }
+            };
+            const_iterator begin() const { return const_iterator(this, 0); }
+            const_iterator end() const {
+                return const_iterator(this, fields.size());
+            }
         };
 
 
@@ -0,0 +1,72 @@
+/**
+    Copyright 2020 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+
+#include <fost/pg/pool.hpp>
+
+
+namespace fostlib {
+
+
+    namespace pg {
+
+
+        class recordset;
+
+
+        /// Sends reads to replicas and writes to the primary database,
+        /// using a `pool` for each of them. The configuration has these
+        /// items:
+        /// 1. primary -- The connection configuration for the primary
+        /// 2. replicas -- An array of connection configurations. Replicas
+        ///     use read only repeatable read transactions unless their
+        ///     configuration says otherwise, as hot standbys can't run
+        ///     serializable transactions
+        /// 3. routing -- Either "round robin" (the default) or
+        ///     "least loaded", which picks the replica with the fewest
+        ///     leased connections
+        /// 4. max_lag -- Seconds a replica may be behind the primary before
+        ///     it is skipped. The lag is measured using
+        ///     `pg_last_xact_replay_timestamp()`, which also grows when the
+        ///     primary is idle. When not given the lag isn't checked
+        /// 5. lag_check -- Seconds between measurements of each replica's
+        ///     lag (default 1)
+        /// Reads go to the primary when no replica is usable. They use a
+        /// separate pool whose transactions are read only, so a `reader`
+        /// can't write wherever it is connected.
+        class router {
+            struct impl;
+            std::shared_ptr<impl> pimpl;
+
+          public:
+            router(const json &configuration);
+
+            /// A connection to the primary
+            pool::lease writer();
+            /// A read only connection, to a replica when one is usable
+            pool::lease reader();
+
+            /// Perform a `select` on a replica
+            recordset select(const char *relation, const json &keys);
+            recordset select(
+                    const char *relation, const json &keys, const json &order);
+            /// Run a query that doesn't write on a replica
+            recordset exec(const utf8_string &);
+
+            /// Where reads have been sent, the replicas' lag and the
+            /// statistics for each pool
+            json statistics() const;
+        };
+
+
+    }
+
+
+}
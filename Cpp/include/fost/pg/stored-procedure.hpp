@@ -19,6 +19,7 @@ namespace fostlib {
 
 
         class connection;
+        class pending;
         class recordset;
 
 
@@ -34,6 +35,17 @@ namespace fostlib {
 
             recordset exec(std::vector<fostlib::string> args);
             recordset exec(const std::vector<fostlib::json> &args);
+            /// Return the results of an earlier run with the same
+            /// arguments from the connection's result cache, running the
+            /// procedure only if they aren't there. Only use this for
+            /// procedures that don't write, as their results are only
+            /// invalidated by `connection::invalidate()`. Once the
+            /// transaction has written to a relation the cache is skipped
+            /// until it ends.
+            recordset cached(const std::vector<fostlib::json> &args);
+            /// Send the procedure to the server without waiting for its
+            /// results
+            pending exec_async(const std::vector<fostlib::json> &args);
         };
 
 